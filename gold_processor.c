@@ -3,6 +3,24 @@
 #include <Trade\OrderInfo.mqh>
 #include <JAson.mqh>
 
+// Define GOLD_DEBUG_LOG to compile the verbose debug statements in. When it is
+// undefined LogDebug() expands to nothing and its arguments are never built.
+// #define GOLD_DEBUG_LOG
+
+#ifdef GOLD_DEBUG_LOG
+#define LogDebug(message) LogAt(LOG_LEVEL_DEBUG, message)
+#else
+#define LogDebug(message)
+#endif
+
+// Log severity
+enum ENUM_LOG_LEVEL {
+   LOG_LEVEL_DEBUG,
+   LOG_LEVEL_INFO,
+   LOG_LEVEL_WARN,
+   LOG_LEVEL_ERROR
+};
+
 CTrade trade;
 CPositionInfo positionInfo;
 COrderInfo orderInfo;
@@ -10,30 +28,75 @@ COrderInfo orderInfo;
 // Input Parameters
 input group "=== Trading Parameters ==="
 input string WebhookPort = "9000";
+input string TradeSymbols = ""; // Comma-separated symbols routed by the signal "symbol" field ("" = chart symbol)
 input double LotSize = 0.01;
+input double AccountLotScale = 1.0; // Multiplier on LotSize for this account
+input double LotScaleReferenceBalance = 0; // >0: also scale lots by account balance / this
 input int SlippagePoints = 30;
 input int MagicNumber = 123456;
 input bool EnableLogging = true;
+input ENUM_LOG_LEVEL LogLevel = LOG_LEVEL_INFO; // Lowest severity recorded
+input string LogFileName = "gold_processor.log"; // Log file in MQL5\Files ("" = terminal only)
+input int LogMaxFileKB = 4096; // Rotate the log file past this size
+input bool LogToTerminal = true; // Also print flushed records to the Experts journal
 
 input group "=== Risk Management ==="
 input double TP3_Offset = 5.0; // Additional pips for TP3 beyond TP1
+input int LadderLegs = 3; // Scale-out legs per signal (2-10): TP1, TP2, extensions, TP3 runner
 input bool EnableTrailingStops = true;
+input int TrailExtraSteps = 0; // Extra trail steps past the last ladder target (0 = ladder only)
+input double TrailStepPoints = 200; // Price move between extra trail steps
+input double TrailDistancePoints = 150; // SL distance behind each extra trail trigger
+input int TrailATRPeriod = 0; // >0: size extra steps from ATR on M5 instead of points
+input double TrailATRMultiplier = 1.0; // ATR multiple for extra step size and distance
 
 input group "=== Order Management ==="
 input int OrderExpirationHours = 24; // Hours before pending orders expire
 input bool UseLimitOrders = true; // true = Limit Orders, false = Market Orders
+input int MaxConcurrentSignals = 4; // Signals managed side by side (up to 16)
+input int ReconcileIntervalSeconds = 30; // Safety-net sweep of leg states against the terminal
+input bool UseAsyncPlacement = false; // Send all legs at once with OrderSendAsync
+input int AsyncAckTimeoutMs = 10000; // Roll back if a leg is not acknowledged in time
+input int RetryBudgetMs = 1500; // Resend requoted/transient failures for this long after the first send
+input int MaxRetriesPerLeg = 3; // Resends per leg within the budget
+input int RetrySlippagePoints = 50; // Market orders: give up once the price is this far past the entry
+input int RetryPauseMs = 100; // Wait before resending after a connection, rate-limit or busy-server retcode (doubles per retry)
+input string StateJournalFile = "gold_processor_state.bin"; // Crash-safe slot journal in MQL5\Files ("" = off)
 
 input group "=== Webhook Configuration ==="
 input string WebhookGetURL = "http://localhost:9000/webhook"; // URL to receive signals
 input string WebhookUpdateURL = "http://localhost:9000/update"; // URL to send signal processing update
-input int SignalCheckIntervalSeconds = 5; // How often to check for new signals
+input int SignalCheckIntervalSeconds = 5; // Longest poll interval when the channel is idle
+input int PollMinIntervalMs = 250; // Poll interval right after a signal burst
+input int PollBurstWindowSeconds = 120; // How long to keep polling tightly after a signal
 input bool EnableWebhookMode = true; // true = Web requests, false = simulation
 input string WebhookToken = "your_secret_token"; // Security token for webhook validation
+input bool EnablePushChannel = false; // Receive signals over a persistent TCP link, HTTP polling as fallback
+input string PushHost = "127.0.0.1"; // Push channel host (must be allowed under Tools > Options > Expert Advisors)
+input int PushPort = 9001; // Push channel port
+input int PushHeartbeatSeconds = 5; // Heartbeat interval; the link is dropped after three silent intervals
+input string SignalJournalFile = ""; // Signal journal in the Common files folder, written by the forwarder ("" = HTTP/push)
+input string FanoutJournalFile = ""; // Common-folder journal shared by EA instances: one elected leader polls, the rest follow ("" = off)
+input int SignalDedupTtlSeconds = 21600; // How long a processed signal id blocks a repeat
+input int SignalMaxAgeSeconds = 300; // Queued signals older than this (from their channel timestamp) are dropped
+input int IntakeSlippagePoints = 50; // Market orders: queued signals are dropped once the price is this far past the entry
+input int StatusFlushIntervalMs = 1000; // How often queued status events are posted to WebhookUpdateURL
+input int StatusBatchSize = 50; // Max events per status POST
+input int StatusTimeoutMs = 300; // Timeout for a status POST (capped at 500: it blocks the timer)
+input string LatencyCsvFile = "gold_processor_latency.csv"; // Latency histogram dump in MQL5\Files ("" = off)
+input int LatencyDumpIntervalSeconds = 300; // How often latency histograms are appended to the CSV
 
 input group "=== Simulation Control ==="
 input bool AutoRunSimulation = false; // Set to true to auto-run simulation on start
+input bool RunParserBenchmark = false; // Benchmark the JSON tokenizer against the legacy helpers on start
+input bool RunBenchmarks = false; // Run the micro-benchmark suite on start
+input int BenchIterations = 20000; // Iterations per benchmark
+input int BenchTickBudgetNs = 2000; // Fail init when the tick path is slower than this (0 = report only)
+input string ReplayTickFile = ""; // Replay recorded chart-symbol ticks on start through a paper book ("" = off)
+input string ReplaySignalFile = ""; // JSON signal log (one per line) injected during the replay
+input string ReplayReportFile = "gold_processor_replay.csv"; // Fills, SL moves and closes from the replay
 
-// Signal Structure
+// Signal Structure, as parsed from the feed
 struct SignalParams {
    string signal;  // "BUY" or "SELL"
    double entry;   // Entry price
@@ -41,84 +104,1142 @@ struct SignalParams {
    double tp1;     // First take profit
    double tp2;     // Second take profit
    string timestamp; // Signal timestamp
+   string symbol;  // Instrument, "" = first of TradeSymbols
    string id;      // Unique signal ID
+   long seq;       // Feed cursor position (0 if the backend does not send one)
+   long journalSeq; // Signal journal record it was read from, 0 otherwise
+   string command; // Feed command in place of a signal ("flatten"), "" for signals
+};
+
+// Trade direction, also used as the sign applied to prices on the trailing path
+enum ENUM_SIGNAL_DIRECTION {
+   SIGNAL_DIR_SELL = -1,
+   SIGNAL_DIR_BUY = 1
+};
+
+// Compact signal record compiled once from SignalParams (see CompileSignal).
+// The intake queue and the slots carry this: no strings, prices as integer
+// points of the symbol, and the id as a reference into the intern pool.
+struct SignalRecord {
+   ENUM_SIGNAL_DIRECTION direction;
+   int sym;        // Index into symbolSpecs
+   long entry;     // Prices in points (price / SymbolSpec.point)
+   long sl;
+   long tp1;
+   long tp2;
+   int id;         // Interned signal id, see InternSignalId()
+   long seq;       // Feed cursor position (0 if the backend does not send one)
+   long postedMs;  // Channel post time from the timestamp, 0 if unknown
+   long journalSeq; // Signal journal record, 0 if it did not come from one
+   bool validated; // Passed ValidateSignalParams; prices are on the tick grid
+};
+
+// Fields recognised by the JSON tokenizer
+enum SIGNAL_FIELD {
+   SIGNAL_FIELD_NONE,
+   SIGNAL_FIELD_SIGNAL,
+   SIGNAL_FIELD_ENTRY,
+   SIGNAL_FIELD_SL,
+   SIGNAL_FIELD_TP1,
+   SIGNAL_FIELD_TP2,
+   SIGNAL_FIELD_TIMESTAMP,
+   SIGNAL_FIELD_ID,
+   SIGNAL_FIELD_SEQ,
+   SIGNAL_FIELD_SYMBOL,
+   SIGNAL_FIELD_COMMAND
+};
+
+// Leg State Tracking
+#define LEG_ACTIVE   1 // Order or position still live
+#define LEG_POSITION 2 // Converted to position, otherwise still pending
+#define MAX_LEGS     10
+
+struct LegState {
+   ulong ticket;
+   double tp;        // Take profit for this leg
+   double sl;        // Current stop loss as last set by the EA
+   double lots;
+   uchar flags;      // LEG_* bits
+   uint trailMask;   // Bit j set: leg follows trail step j
+   uint trailDone;   // Trail steps already applied
+   uint requestId;   // Outstanding OrderSendAsync request, 0 when none
+   ulong sentUs;     // GetMicrosecondCount() when the leg was sent
+   ulong ackUs;      // When the server accepted it
+   ulong fillUs;     // When the fill was seen
+   int attempts;     // Retries spent on placement
+   double sendPrice; // Price of the last placement attempt
+   ulong retryAtMs;  // Async resend waiting for OnTimer, 0 when none
+};
+
+// Compiled trailing action: when the signed price reaches trigger, move
+// legs[leg] to stepSL[step]
+#define MAX_TRAIL_STEPS   32
+#define MAX_TRAIL_ACTIONS (MAX_LEGS * MAX_TRAIL_STEPS)
+
+struct TrailAction {
+   double trigger; // Trigger price multiplied by the direction
+   uchar leg;
+   uchar step;
+};
+
+// Outbound status event for WebhookUpdateURL
+enum ENUM_STATUS_EVENT {
+   STATUS_PLACED,
+   STATUS_FILLED,
+   STATUS_SL_MOVED,
+   STATUS_CLOSED,
+   STATUS_CANCELLED
+};
+
+struct StatusEvent {
+   ENUM_STATUS_EVENT type;
+   string signalId;
+   string symbol;
+   int digits;
+   ulong ticket;
+   int leg;         // 1-based leg number
+   double price;    // Entry, fill, trigger or close price depending on type
+   double sl;
+   double tp;
+   datetime time;
+   string trace;    // Optional per-signal latency trace JSON
+};
+
+// Per-signal latency trace. Microsecond stamps are GetMicrosecondCount();
+// postedMs and fetchWallMs are wall-clock UTC milliseconds.
+struct SignalTrace {
+   long postedMs;       // Channel post time from the signal timestamp, 0 if unknown
+   long fetchWallMs;    // Wall clock when the fetch started
+   ulong fetchStartUs;  // 0 for signals that did not come from a fetch
+   ulong fetchDoneUs;
+   ulong parseDoneUs;
+   ulong validateDoneUs;
+};
+
+// Latency stages aggregated into histograms
+enum ENUM_LATENCY_STAGE {
+   LAT_POST_TO_FETCH,
+   LAT_FETCH,
+   LAT_PARSE,
+   LAT_VALIDATE,
+   LAT_LEG_SEND_TO_ACK,
+   LAT_FETCH_TO_LIVE,
+   LAT_ACK_TO_FILL,
+   LAT_POST_TO_FILL,
+   LAT_STAGE_COUNT
+};
+
+#define LATENCY_BUCKETS 40 // Bucket b holds [2^b, 2^(b+1)) microseconds
+
+struct LatencyHistogram {
+   ulong buckets[LATENCY_BUCKETS];
+   ulong count;
+   ulong sumUs;
+   ulong maxUs;
+};
+
+// Paper order used by the replay harness in place of a terminal ticket
+#define PAPER_NONE     0
+#define PAPER_PENDING  1
+#define PAPER_POSITION 2
+
+struct PaperOrder {
+   ulong ticket;
+   uchar state;
+   int dir;          // +1 buy, -1 sell
+   double price;     // Limit price, or open price once filled
+   double sl;
+   double tp;
+   double lots;
+   double contractSize;
+   long expiryMs;
 };
 
-// Order State Tracking
-struct OrderState {
+// State journal records
+#define JOURNAL_SLOT    1 // Full snapshot of one slot
+#define JOURNAL_RELEASE 2 // Slot finished
+#define JOURNAL_CURSOR  3 // Feed cursor and last processed signal id
+#define JOURNAL_FEED    4 // Signal journal records consumed
+#define JOURNAL_COMMAND 5 // Last feed command handled and its feed seq
+#define JOURNAL_ID_LEN  64
+#define JOURNAL_SYMBOL_LEN 32
+#define JOURNAL_COMPACT_BYTES 1048576
+
+struct JournalLeg {
    ulong ticket;
-   bool isActive;
-   bool isPosition; // true if converted to position, false if still pending
-   bool tp1_hit;
-   bool tp2_hit;
-   bool sl_moved_to_entry;
-   bool sl_moved_to_tp1;
+   double tp;
+   double sl;
+   double lots;
+   uint trailMask;
+   uint trailDone;
+   uchar flags;
+};
+
+struct JournalRecord {
+   uchar type;
+   char direction;
+   uchar legCount;
+   uchar stepCount;
+   long seq;                  // Signal seq, the feed cursor for JOURNAL_CURSOR, the command seq for JOURNAL_COMMAND
+   double entry;
+   double sl;
+   double tp1;
+   double tp2;
+   uchar id[JOURNAL_ID_LEN];  // Signal id, the last processed id for JOURNAL_CURSOR, the command id for JOURNAL_COMMAND
+   uchar symbol[JOURNAL_SYMBOL_LEN];
+   double stepTrigger[MAX_TRAIL_STEPS];
+   double stepSL[MAX_TRAIL_STEPS];
+   JournalLeg legs[MAX_LEGS];
+};
+
+// Signal journal record, as appended by signal_journal.py or a fan-out
+// leader. MQL5 structs are packed, so this is exactly the Python struct
+// format '<Iqqqb4d16s64sI'.
+#define FEED_RECORD_MAGIC 0x31464753 // "SGF1"
+#define FEED_SYMBOL_LEN   16
+#define FEED_ID_LEN       64
+
+struct FeedRecord {
+   uint magic;
+   long seq;                      // 1-based; record n sits at (n - 1) * sizeof(FeedRecord)
+   long feedSeq;                  // Upstream feed cursor of the signal, 0 if none
+   long postedMs;                 // Channel post time, UTC ms, 0 if unknown
+   char direction;                // 1 BUY, -1 SELL
+   double entry;
+   double sl;
+   double tp1;
+   double tp2;
+   uchar symbol[FEED_SYMBOL_LEN]; // "" = first of TradeSymbols
+   uchar id[FEED_ID_LEN];
+   uint checksum;                 // FNV-1a over every byte before it
+};
+
+// Signal Slot: one live signal and its legs
+struct SignalSlot {
+   int index;         // Position in slots[], used as the ticket index reference
+   bool inUse;
+   SignalRecord sig;
+   bool ordersPlaced; // at least one leg still pending
+   bool tradesOpened; // at least one leg filled
+   ENUM_SIGNAL_DIRECTION direction;
+   int sym;                  // Index into symbolSpecs
+   LegState legs[MAX_LEGS];
+   int legCount;
+   double stepTrigger[MAX_TRAIL_STEPS]; // Price that fires trail step j
+   double stepSL[MAX_TRAIL_STEPS];      // SL that trail step j moves to
+   int stepCount;
+   TrailAction actions[MAX_TRAIL_ACTIONS]; // Pending actions sorted by signed trigger
+   int actionCount;
+   int nextAction;
+   double nextTrigger;                  // actions[nextAction].trigger, DBL_MAX when none
+   bool journalDirty;                   // Trail progress not journaled yet; OnTimer writes it
+   int pendingAcks;                     // Async legs still waiting for a server reply
+   bool placementFailed;
+   ulong placeStartUs;
+   ulong placeDeadlineMs;
+   datetime placeExpiration; // Pending order expiry, kept for async resends
+   int retries;              // Placement retries across all legs
+   ulong retryUs;            // Time lost to failed attempts
+   SignalTrace trace;
+};
+
+#define MAX_SIGNAL_SLOTS 16
+
+// Per-symbol trading spec, read once at start
+#define MAX_SYMBOLS 8
+
+struct SymbolSpec {
+   string name;
+   double point;
+   int digits;
+   double tickSize;
+   int stopsLevel;          // Points
+   int freezeLevel;         // Points
+   ENUM_ORDER_TYPE_FILLING filling;
+   double contractSize;
+   double volumeMin;
+   double volumeMax;
+   double volumeStep;
+   int atrHandle;
+   MqlTick tick;            // Last tick read for the trailing path
+   bool hasTick;
 };
 
+SymbolSpec symbolSpecs[MAX_SYMBOLS];
+int symbolCount = 0;
+
 // Global Variables
-SignalParams sig;
-bool ordersPlaced = false;
-bool tradesOpened = false;
-OrderState order1, order2, order3;
-datetime lastSignalCheck = 0;
+SignalSlot slots[MAX_SIGNAL_SLOTS];
+int liveSlots[MAX_SIGNAL_SLOTS]; // Dense list of in-use slot indices, so ticks only touch live signals
+int liveSlotCount = 0;
+int liveBuySlots[MAX_SIGNAL_SLOTS]; // The same slots split by direction for the tick path
+int liveBuyCount = 0;
+int liveSellSlots[MAX_SIGNAL_SLOTS];
+int liveSellCount = 0;
 string lastProcessedSignalId = "";
+string lastCommandId = "";    // Last feed command handled; journaled so a restart never repeats it
+long lastCommandSeq = 0;
+long signalCursor = 0;        // Highest feed seq consumed, sent back as ?since=
+
+// Ticket -> Leg Index
+#define TICKET_INDEX_BITS 9
+#define TICKET_INDEX_SIZE 512 // 1 << TICKET_INDEX_BITS, well above MAX_SIGNAL_SLOTS * MAX_LEGS
+ulong ticketKeys[TICKET_INDEX_SIZE]; // 0 = empty bucket
+int ticketRefs[TICKET_INDEX_SIZE];   // slot * MAX_LEGS + leg
+ulong nextReconcileMs = 0;
+int asyncPlacementsInFlight = 0;
+
+// Async placement stragglers
+#define ORPHAN_ACK_SIZE  64
+#define EARLY_FILL_SIZE  16
+uint orphanRequestIds[ORPHAN_ACK_SIZE]; // Requests given up on at AsyncAckTimeoutMs, 0 = free
+int orphanAckCount = 0;
+int orphanAckNext = 0;
+ulong earlyFillOrders[EARLY_FILL_SIZE]; // Entry deals seen before their placement ack, 0 = free
+double earlyFillPrices[EARLY_FILL_SIZE];
+int earlyFillNext = 0;
+
+// State Journal
+int journalFile = INVALID_HANDLE;
+long journaledCursor = -1;
+string journaledSignalId = "";
+string journaledCommandId = "";
+
+// Signal Dedup Index
+#define DEDUP_BITS     10
+#define DEDUP_SIZE     1024 // 1 << DEDUP_BITS, twice DEDUP_CAPACITY
+#define DEDUP_CAPACITY 512  // Most recent signal ids remembered
+ulong dedupKeys[DEDUP_SIZE];  // Id hash, 0 = empty bucket
+ulong dedupSeenMs[DEDUP_SIZE];
+ulong dedupOrder[DEDUP_CAPACITY]; // Insertion ring used for eviction
+ulong dedupOrderMs[DEDUP_CAPACITY];
+int dedupNext = 0;
+int dedupHits = 0;
+int dedupMisses = 0;
+int dedupExpired = 0;         // Misses on an id that was seen but past its TTL
+
+// Interned Signal Ids
+#define INTERN_SIZE 256 // Well above MAX_SIGNAL_SLOTS + INTAKE_QUEUE_SIZE
+ulong internKeys[INTERN_SIZE]; // SignalIdHash of the id, 0 = free
+string internIds[INTERN_SIZE];
+int internNext = 0;
+
+// Signal Intake Queue
+#define INTAKE_QUEUE_SIZE 64
+
+struct IntakeEntry {
+   SignalRecord sig;
+   SignalTrace trace;
+   long sortMs;                // Channel timestamp, or wall clock at pickup when it has none
+   ulong queuedMs;             // GetTickCount64() at pickup
+};
+
+IntakeEntry intakeQueue[INTAKE_QUEUE_SIZE]; // Kept sorted by sortMs, oldest first
+int intakeCount = 0;
+int intakeExecuted = 0;
+int intakeExpired = 0;        // Dropped past SignalMaxAgeSeconds
+int intakeOvertaken = 0;      // Dropped because the market already moved past the entry
+ulong intakeWaitSumMs = 0;    // Queue wait of executed signals
+ulong intakeWaitMaxMs = 0;
+
+// Status Queue
+#define STATUS_QUEUE_SIZE 512
+#define STATUS_TIMEOUT_CAP_MS 500
+StatusEvent statusQueue[STATUS_QUEUE_SIZE];
+int statusHead = 0;
+int statusCount = 0;
+int statusDropped = 0;        // Events lost to overflow since the last successful flush
+ulong nextStatusFlushMs = 0;
+uint statusBackoffMs = 0;
+
+// Log Ring
+#define LOG_RING_SIZE   2048
+#define LOG_FLUSH_BATCH 256
+
+struct LogRecord {
+   ENUM_LOG_LEVEL level;
+   datetime time;
+   bool templated; // text holds %i/%p/%s placeholders filled at flush
+   string text;
+   long i0, i1;
+   long i2, i3, i4; // LogFmtWide only
+   double p0;
+   double p1, p2, p3;
+   int digits;     // Precision of %p, the price's symbol digits (-1 = chart symbol)
+   string s0, s1;
+};
+
+LogRecord logRing[LOG_RING_SIZE];
+int logHead = 0;
+int logCount = 0;
+int logDropped = 0;
+int logFile = INVALID_HANDLE;
+
+// Latency Tracing
+LatencyHistogram latencyStages[LAT_STAGE_COUNT];
+SignalTrace pollTrace;        // Fetch stamps for the response being processed
+ulong nextLatencyDumpMs = 0;
+long wallAnchorMs = 0;        // TimeGMT() in ms when a second began...
+ulong wallAnchorUs = 0;       // ...and GetMicrosecondCount() at that moment
+
+// Replay Harness State
+bool replayActive = false;
+MqlTick replayTick;           // Tick being replayed; stands in for the market in replay mode
+PaperOrder paperBook[MAX_SIGNAL_SLOTS * MAX_LEGS]; // Indexed like ticketRefs: slot * MAX_LEGS + leg
+ulong replayNextTicket = 1;
+SignalParams replaySignals[];
+long replaySignalMs[];
+int replayReport = INVALID_HANDLE;
+int replayFills = 0;
+int replaySlMoves = 0;
+int replayCloses = 0;
+double replayPnl = 0;
+
+// Push Channel
+#define PUSH_FRAME_HELLO     'H'
+#define PUSH_FRAME_SIGNAL    'S'
+#define PUSH_FRAME_HEARTBEAT 'B'
+#define PUSH_MAX_FRAME       1048576
+int pushSocket = INVALID_HANDLE;
+uchar pushRx[];               // Received bytes not yet framed
+ulong pushLastRxMs = 0;
+ulong pushLastTxMs = 0;
+ulong pushNextConnectMs = 0;
+uint pushBackoffMs = 0;
+int pushSignalFrames = 0;
+
+// Signal Journal Feed
+int feedFile = INVALID_HANDLE;
+long feedCursor = 0;          // Journal records consumed; persisted like signalCursor
+long journaledFeedCursor = -1;
+ulong feedNextOpenMs = 0;
+int feedRecords = 0;
+int feedCorrupt = 0;          // Records skipped because their checksum never matched
 
-// Logging function
+// Fan-out Leader State
+int fanoutLock = INVALID_HANDLE;   // Exclusive handle on the lock file, held while leader
+int fanoutWriter = INVALID_HANDLE;
+long fanoutSeq = 0;           // Whole records in the fan-out journal
+ulong fanoutNextElectMs = 0;
+int fanoutPublished = 0;
+
+// Flatten State
+#define FLATTEN_MAX_TARGETS 256
+#define FLATTEN_MAX_ROUNDS  3
+
+struct FlattenTarget {
+   ulong ticket;
+   bool position;    // Position to close, otherwise pending order to delete
+   uint requestId;   // Outstanding OrderSendAsync request, 0 when none
+   int attempts;
+   bool done;        // Confirmed gone, or given up on for this round
+};
+
+FlattenTarget flattenTargets[FLATTEN_MAX_TARGETS];
+int flattenTargetCount = 0;
+int flattenOpen = 0;          // Targets of the current round not yet done
+bool flattenActive = false;
+int flattenRounds = 0;
+ulong flattenStartUs = 0;
+ulong flattenDeadlineMs = 0;
+int flattenRequests = 0;      // Requests sent by the current or last run
+int flattenRuns = 0;
+ulong flattenLastUs = 0;      // Time to flat of the last run
+int flattenLastLeft = 0;      // Orders and positions still open after the last run
+
+// Poll Scheduler State
+ulong nextPollDueMs = 0;      // GetTickCount64() value at which the next poll is allowed
+ulong lastPollMs = 0;         // When the previous poll was sent
+ulong lastSignalSeenMs = 0;   // When the last new signal was picked up
+uint currentPollIntervalMs = 0;
+
+// Placement Retry Metrics
+int retryAttempts = 0;        // Resends after a transient retcode
+int retrySignalsRecovered = 0; // Signals fully placed that needed at least one retry
+int retryExhausted = 0;       // Legs that still failed after retrying
+ulong retryAddedUsSum = 0;    // Latency added by failed attempts on recovered signals
+
+// Set by ProcessWebhookSignal when the intake queue was full and signals
+// were left unconsumed; they are fetched again from signalCursor
+bool signalsDeferred = false;
+
+// Conditional Poll Counters
+string pollETag = "";         // ETag of the last 200 response, sent back as If-None-Match
+ulong lastPollBodyHash = 0;
+int pollsEmpty = 0;           // 204/304 or an empty 200: nothing downloaded or parsed
+int pollsStale = 0;           // 200 whose payload held nothing new
+int pollsUseful = 0;          // Brought at least one new signal
+int pollsFailed = 0;
+
+// Signal Pickup Latency Stats
+int pickupCount = 0;
+ulong pickupGapSumMs = 0;     // Sum of poll gaps in which a new signal was found
+ulong pickupGapMaxMs = 0;
+long postToPickupSumMs = 0;   // Channel post time -> pickup, when timestamp is parseable
+long postToPickupMaxMs = 0;
+int postToPickupCount = 0;
+
+// Logging functions
+// Calls only append a record to a fixed ring; timestamps, number formatting
+// and file/terminal output happen in FlushLog() from OnTimer. Hot paths use
+// LogFmt() with %i (integer), %p (price), %s (string) placeholders so even the
+// message text is assembled at flush time.
 void LogMessage(string message) {
-   if (EnableLogging) {
-      Print("[", TimeToString(TimeCurrent()), "] ", message);
+   LogAt(LOG_LEVEL_INFO, message);
+}
+
+void LogWarn(string message) {
+   LogAt(LOG_LEVEL_WARN, message);
+}
+
+void LogError(string message) {
+   LogAt(LOG_LEVEL_ERROR, message);
+}
+
+void LogAt(ENUM_LOG_LEVEL level, string message) {
+   if (!EnableLogging || level < LogLevel) return;
+   
+   int i = LogReserve(level);
+   logRing[i].templated = false;
+   logRing[i].text = message;
+}
+
+void LogFmt(ENUM_LOG_LEVEL level, string fmt, long i0 = 0, long i1 = 0, double p0 = 0, string s0 = "", string s1 = "", int digits = -1) {
+   if (!EnableLogging || level < LogLevel) return;
+   
+   int i = LogReserve(level);
+   logRing[i].templated = true;
+   logRing[i].text = fmt;
+   logRing[i].i0 = i0;
+   logRing[i].i1 = i1;
+   logRing[i].p0 = p0;
+   logRing[i].digits = digits;
+   logRing[i].s0 = s0;
+   logRing[i].s1 = s1;
+}
+
+// LogFmt for lines with more numbers: %i takes i0..i4 and %p p0..p3 in order
+void LogFmtWide(ENUM_LOG_LEVEL level, string fmt, long i0, long i1, long i2, long i3 = 0, long i4 = 0,
+                double p0 = 0, double p1 = 0, double p2 = 0, double p3 = 0, string s0 = "", string s1 = "", int digits = -1) {
+   if (!EnableLogging || level < LogLevel) return;
+   
+   int i = LogReserve(level);
+   logRing[i].templated = true;
+   logRing[i].text = fmt;
+   logRing[i].i0 = i0;
+   logRing[i].i1 = i1;
+   logRing[i].i2 = i2;
+   logRing[i].i3 = i3;
+   logRing[i].i4 = i4;
+   logRing[i].p0 = p0;
+   logRing[i].p1 = p1;
+   logRing[i].p2 = p2;
+   logRing[i].p3 = p3;
+   logRing[i].digits = digits;
+   logRing[i].s0 = s0;
+   logRing[i].s1 = s1;
+}
+
+int LogReserve(ENUM_LOG_LEVEL level) {
+   if (logCount == LOG_RING_SIZE) {
+      // Full: overwrite the oldest record and report the loss at flush
+      logHead = (logHead + 1) % LOG_RING_SIZE;
+      logCount--;
+      logDropped++;
    }
+   
+   int i = (logHead + logCount) % LOG_RING_SIZE;
+   logCount++;
+   logRing[i].level = level;
+   logRing[i].time = TimeCurrent();
+   return i;
 }
 
-void OnTick() {
-   // Check for new signals via webhook if enabled
-   if (EnableWebhookMode && !ordersPlaced && !tradesOpened) {
+// Expand %i/%p/%s placeholders in argument order
+string FormatLogRecord(LogRecord &r) {
+   if (!r.templated) return r.text;
+   
+   string out = "";
+   int len = StringLen(r.text);
+   int start = 0;
+   int ints = 0, prices = 0, strs = 0;
+   
+   for (int k = 0; k < len - 1; k++) {
+      if (StringGetCharacter(r.text, k) != '%') continue;
+      
+      ushort c = StringGetCharacter(r.text, k + 1);
+      string arg;
+      if (c == 'i') arg = IntegerToString(LogRecordInt(r, ints++));
+      else if (c == 'p') arg = DoubleToString(LogRecordPrice(r, prices++), r.digits >= 0 ? r.digits : _Digits);
+      else if (c == 's') arg = strs++ == 0 ? r.s0 : r.s1;
+      else continue;
+      
+      out += StringSubstr(r.text, start, k - start) + arg;
+      start = k + 2;
+      k++;
+   }
+   
+   return out + StringSubstr(r.text, start);
+}
+
+long LogRecordInt(LogRecord &r, int n) {
+   switch (n) {
+      case 0: return r.i0;
+      case 1: return r.i1;
+      case 2: return r.i2;
+      case 3: return r.i3;
+   }
+   return r.i4;
+}
+
+double LogRecordPrice(LogRecord &r, int n) {
+   switch (n) {
+      case 0: return r.p0;
+      case 1: return r.p1;
+      case 2: return r.p2;
+   }
+   return r.p3;
+}
+
+string LogLevelName(ENUM_LOG_LEVEL level) {
+   switch (level) {
+      case LOG_LEVEL_DEBUG: return "DEBUG";
+      case LOG_LEVEL_INFO:  return "INFO";
+      case LOG_LEVEL_WARN:  return "WARN";
+      case LOG_LEVEL_ERROR: return "ERROR";
+   }
+   return "?";
+}
+
+// Write up to maxRecords buffered records to the terminal and the log file
+void FlushLog(int maxRecords = LOG_FLUSH_BATCH) {
+   if (logCount == 0) return;
+   
+   if (LogFileName != "" && logFile == INVALID_HANDLE) OpenLogFile();
+   
+   if (logDropped > 0) {
+      WriteLogLine("[" + TimeToString(TimeCurrent(), TIME_DATE | TIME_SECONDS) + "] [WARN] " +
+                   IntegerToString(logDropped) + " log records dropped (ring full)");
+      logDropped = 0;
+   }
+   
+   int n = MathMin(logCount, maxRecords);
+   for (int k = 0; k < n; k++) {
+      int i = (logHead + k) % LOG_RING_SIZE;
+      WriteLogLine("[" + TimeToString(logRing[i].time, TIME_DATE | TIME_SECONDS) + "] [" +
+                   LogLevelName(logRing[i].level) + "] " + FormatLogRecord(logRing[i]));
+      // Release string storage held by the slot
+      logRing[i].text = "";
+      logRing[i].s0 = "";
+      logRing[i].s1 = "";
+   }
+   logHead = (logHead + n) % LOG_RING_SIZE;
+   logCount -= n;
+   
+   if (logFile != INVALID_HANDLE) {
+      FileFlush(logFile);
+      if (FileSize(logFile) > (ulong)MathMax(LogMaxFileKB, 16) * 1024) RotateLogFile();
+   }
+}
+
+void WriteLogLine(string line) {
+   if (LogToTerminal) Print(line);
+   if (logFile != INVALID_HANDLE) FileWriteString(logFile, line + "\r\n");
+}
+
+void OpenLogFile() {
+   logFile = FileOpen(LogFileName, FILE_READ | FILE_WRITE | FILE_TXT | FILE_ANSI | FILE_SHARE_READ);
+   if (logFile == INVALID_HANDLE) {
+      Print("Failed to open log file ", LogFileName, ". Error: ", GetLastError());
+      return;
+   }
+   FileSeek(logFile, 0, SEEK_END);
+}
+
+// Keep one previous generation: <name>.1
+void RotateLogFile() {
+   FileClose(logFile);
+   logFile = INVALID_HANDLE;
+   if (!FileMove(LogFileName, 0, LogFileName + ".1", FILE_REWRITE)) {
+      Print("Failed to rotate log file. Error: ", GetLastError());
+   }
+   OpenLogFile();
+}
+
+void CloseLog() {
+   while (logCount > 0) FlushLog(LOG_RING_SIZE);
+   if (logFile != INVALID_HANDLE) {
+      FileClose(logFile);
+      logFile = INVALID_HANDLE;
+   }
+}
+
+void OnTimer() {
+   CheckPlacementTimeouts();
+   CheckFlattenTimeout();
+   
+   // OnTick only fires for the chart symbol; the others trail at timer cadence
+   if (symbolCount > 1 && liveSlotCount > 0) {
+      ManageLiveSlots();
+   }
+   JournalDirtySlots();
+   
+   if (GetTickCount64() >= nextReconcileMs) {
+      ReconcileSlots();
+      RefreshSymbolLevels();
+      nextReconcileMs = GetTickCount64() + (ulong)MathMax(ReconcileIntervalSeconds, 1) * 1000;
+   }
+   
+   // Signals arrive over the push channel while it is up, otherwise via
+   // webhook polling. Both keep running while every slot is busy; new signals
+   // wait in the intake queue, and whatever does not fit stays on the feed.
+   // A configured signal journal replaces both, as does following a fan-out
+   // leader.
+   bool fanout = SignalJournalFile == "" && FanoutJournalFile != "";
+   if (fanout) FanoutElect();
+   bool journalFeed = SignalJournalFile != "" || (fanout && !FanoutLeader());
+   if (journalFeed) FeedPump();
+   bool pushLive = !journalFeed && EnableWebhookMode && EnablePushChannel && PushPump();
+   if (!journalFeed && EnableWebhookMode && IntakeHasRoom() && !pushLive) {
       CheckForNewSignals();
    }
+   DrainIntakeQueue();
+   
+   FlushStatusQueue();
+   
+   if (GetTickCount64() >= nextLatencyDumpMs) {
+      DumpLatencyCsv();
+      nextLatencyDumpMs = GetTickCount64() + (ulong)MathMax(LatencyDumpIntervalSeconds, 10) * 1000;
+   }
    
-   if (!ordersPlaced && !tradesOpened) return;
+   FlushLog();
+}
+
+void OnTick() {
+   if (liveSlotCount == 0) return;
    
-   // Check if pending orders have been filled
-   if (ordersPlaced && !tradesOpened) {
-      CheckOrderFills();
+   ManageLiveSlots();
+}
+
+// Resolve TradeSymbols into the spec cache. Everything the trading paths need
+// per instrument is read here once, so they never go back to SymbolInfo*.
+bool LoadSymbolSpecs() {
+   string names[];
+   int n = TradeSymbols == "" ? 0 : StringSplit(TradeSymbols, ',', names);
+   if (n <= 0) {
+      ArrayResize(names, 1);
+      names[0] = _Symbol;
+      n = 1;
    }
    
-   // Update position states if trades are opened
-   if (tradesOpened) {
-      UpdatePositionStates();
+   symbolCount = 0;
+   for (int i = 0; i < n && symbolCount < MAX_SYMBOLS; i++) {
+      string name = names[i];
+      StringTrimLeft(name);
+      StringTrimRight(name);
+      if (name == "" || FindSymbolSpec(name) >= 0) continue;
       
-      if (EnableTrailingStops) {
-         double price = SymbolInfoDouble(_Symbol, sig.signal == "BUY" ? SYMBOL_BID : SYMBOL_ASK);
-         
-         if (sig.signal == "BUY") {
-            HandleBuyTrailingStops(price);
-         } else if (sig.signal == "SELL") {
-            HandleSellTrailingStops(price);
+      if (!SymbolSelect(name, true)) {
+         LogError("Unknown symbol in TradeSymbols: " + name);
+         return false;
+      }
+      
+      int s = symbolCount++;
+      symbolSpecs[s].name = name;
+      symbolSpecs[s].point = SymbolInfoDouble(name, SYMBOL_POINT);
+      symbolSpecs[s].digits = (int)SymbolInfoInteger(name, SYMBOL_DIGITS);
+      symbolSpecs[s].tickSize = SymbolInfoDouble(name, SYMBOL_TRADE_TICK_SIZE);
+      symbolSpecs[s].stopsLevel = (int)SymbolInfoInteger(name, SYMBOL_TRADE_STOPS_LEVEL);
+      symbolSpecs[s].freezeLevel = (int)SymbolInfoInteger(name, SYMBOL_TRADE_FREEZE_LEVEL);
+      symbolSpecs[s].filling = SymbolFillingMode(name);
+      symbolSpecs[s].contractSize = SymbolInfoDouble(name, SYMBOL_TRADE_CONTRACT_SIZE);
+      symbolSpecs[s].volumeMin = SymbolInfoDouble(name, SYMBOL_VOLUME_MIN);
+      symbolSpecs[s].volumeMax = SymbolInfoDouble(name, SYMBOL_VOLUME_MAX);
+      symbolSpecs[s].volumeStep = SymbolInfoDouble(name, SYMBOL_VOLUME_STEP);
+      symbolSpecs[s].hasTick = false;
+      
+      symbolSpecs[s].atrHandle = INVALID_HANDLE;
+      if (TrailATRPeriod > 0) {
+         symbolSpecs[s].atrHandle = iATR(name, PERIOD_M5, TrailATRPeriod);
+         if (symbolSpecs[s].atrHandle == INVALID_HANDLE) {
+            LogWarn("Failed to create ATR handle for " + name + ", falling back to point-based trail steps");
          }
       }
    }
+   
+   return symbolCount > 0;
+}
+
+// Stops and freeze levels can change intraday; re-read them with the sweep
+void RefreshSymbolLevels() {
+   for (int s = 0; s < symbolCount; s++) {
+      symbolSpecs[s].stopsLevel = (int)SymbolInfoInteger(symbolSpecs[s].name, SYMBOL_TRADE_STOPS_LEVEL);
+      symbolSpecs[s].freezeLevel = (int)SymbolInfoInteger(symbolSpecs[s].name, SYMBOL_TRADE_FREEZE_LEVEL);
+   }
+}
+
+// Spec index for a symbol name; "" means the first configured symbol
+int FindSymbolSpec(string name) {
+   if (name == "") return symbolCount > 0 ? 0 : -1;
+   for (int i = 0; i < symbolCount; i++) {
+      if (symbolSpecs[i].name == name) return i;
+   }
+   return -1;
+}
+
+// Read one tick per symbol that has live slots, then run the trailing path
+void ManageLiveSlots() {
+   if (!EnableTrailingStops) return;
+   
+   uint needed = 0;
+   for (int i = 0; i < liveSlotCount; i++) needed |= (uint)1 << slots[liveSlots[i]].sym;
+   
+   for (int s = 0; s < symbolCount; s++) {
+      if ((needed & ((uint)1 << s)) == 0) continue;
+      symbolSpecs[s].hasTick = SymbolInfoTick(symbolSpecs[s].name, symbolSpecs[s].tick);
+      if (!symbolSpecs[s].hasTick) continue;
+      ManageBuySlots(s, symbolSpecs[s].tick.bid);
+      ManageSellSlots(s, symbolSpecs[s].tick.ask);
+   }
 }
 
 // NEW: Check for new signals via web request
 void CheckForNewSignals() {
-   // Throttle signal checking
-   if (TimeCurrent() - lastSignalCheck < SignalCheckIntervalSeconds) {
+   // Throttle signal checking on the local millisecond clock, not server time
+   ulong now = GetTickCount64();
+   if (now < nextPollDueMs) {
       return;
    }
    
-   lastSignalCheck = TimeCurrent();
+   ulong previousPollMs = lastPollMs;
+   lastPollMs = now;
    
    // Make web request to get latest signal
    string response = "";
-   if (MakeWebRequest(response, WebhookGetURL)) {
-     ProcessWebhookSignal(response);
+   pollTrace.fetchWallMs = WallClockMs();
+   pollTrace.fetchStartUs = GetMicrosecondCount();
+   int status = MakeWebRequest(response, WebhookGetURL, "since=" + IntegerToString(signalCursor));
+   pollTrace.fetchDoneUs = GetMicrosecondCount();
+   
+   // A backend without ETag support keeps returning the same body; skip
+   // parsing it again
+   ulong bodyHash = status == 200 && response != "" ? SignalIdHash(response) : 0;
+   
+   if (bodyHash != 0 && bodyHash == lastPollBodyHash) {
+      pollsStale++;
+   } else if (bodyHash != 0) {
+      lastPollBodyHash = bodyHash;
+      long cursorBefore = signalCursor;
+      bool placed = ProcessWebhookSignal(response, previousPollMs);
+      JournalCursor();
+      // A backend that ignores since= sends this body again; it still holds
+      // the deferred signals, so it must be parsed again
+      if (signalsDeferred) lastPollBodyHash = 0;
+      
+      if (placed || signalCursor != cursorBefore) pollsUseful++;
+      else pollsStale++;
+   } else if (status == 200 || status == 204 || status == 304) {
+      pollsEmpty++;
+   } else {
+      pollsFailed++;
+   }
+   
+   ScheduleNextPoll();
+}
+
+// Adaptive poll interval: tight right after a signal, doubling back off towards
+// SignalCheckIntervalSeconds while the source channel stays quiet
+void ScheduleNextPoll() {
+   uint minInterval = (uint)MathMax(PollMinIntervalMs, 10);
+   uint maxInterval = (uint)MathMax(SignalCheckIntervalSeconds * 1000, (int)minInterval);
+   ulong now = GetTickCount64();
+   
+   if (lastSignalSeenMs > 0 && now - lastSignalSeenMs < (ulong)PollBurstWindowSeconds * 1000) {
+      currentPollIntervalMs = minInterval;
+   } else if (currentPollIntervalMs == 0) {
+      currentPollIntervalMs = maxInterval;
+   } else {
+      currentPollIntervalMs = (uint)MathMin(currentPollIntervalMs * 2, maxInterval);
+   }
+   
+   nextPollDueMs = now + currentPollIntervalMs;
+}
+
+// Record how long a new signal could have waited before the EA picked it up
+void RecordSignalPickup(SignalParams &s, ulong previousPollMs) {
+   ulong now = GetTickCount64();
+   ulong gap = previousPollMs > 0 ? now - previousPollMs : 0;
+   
+   lastSignalSeenMs = now;
+   currentPollIntervalMs = (uint)MathMax(PollMinIntervalMs, 10);
+   
+   pickupCount++;
+   pickupGapSumMs += gap;
+   if (gap > pickupGapMaxMs) pickupGapMaxMs = gap;
+   
+   long postedMs = ParseSignalTimeMs(s.timestamp);
+   if (postedMs > 0) {
+      long sincePost = WallClockMs() - postedMs;
+      if (sincePost < 0) sincePost = 0;
+      postToPickupCount++;
+      postToPickupSumMs += sincePost;
+      if (sincePost > postToPickupMaxMs) postToPickupMaxMs = sincePost;
+      LogFmt(LOG_LEVEL_INFO, "Signal pickup: poll gap %i ms, %i ms since channel post", (long)gap, sincePost);
+   } else {
+      LogFmt(LOG_LEVEL_INFO, "Signal pickup: poll gap %i ms", (long)gap);
+   }
+   
+   LogPickupLatencyStats();
+}
+
+void LogPickupLatencyStats() {
+   if (pickupCount == 0) return;
+   
+   long gapAvg = (long)(pickupGapSumMs / pickupCount);
+   if (postToPickupCount > 0) {
+      LogFmtWide(LOG_LEVEL_INFO, "Pickup latency over %i signals: poll gap avg %i ms, max %i ms; post->pickup avg %i ms, max %i ms",
+                 pickupCount, gapAvg, (long)pickupGapMaxMs, postToPickupSumMs / postToPickupCount, postToPickupMaxMs);
+   } else {
+      LogFmtWide(LOG_LEVEL_INFO, "Pickup latency over %i signals: poll gap avg %i ms, max %i ms", pickupCount, gapAvg, (long)pickupGapMaxMs);
+   }
+}
+
+// Latency tracing. Each signal carries a SignalTrace of microsecond stamps
+// from the fetch to each leg's ack and fill. The channel post time is wall
+// clock and gets lined up through the wall time taken at fetch. Stage
+// durations go into log2 histograms, which are dumped to LatencyCsvFile and
+// attached to the status updates.
+void RecordLatency(int stage, long us) {
+   if (us < 0) return;
+   
+   int bucket = 0;
+   while (bucket < LATENCY_BUCKETS - 1 && ((long)1 << (bucket + 1)) <= us) bucket++;
+   
+   latencyStages[stage].buckets[bucket]++;
+   latencyStages[stage].count++;
+   latencyStages[stage].sumUs += us;
+   if ((ulong)us > latencyStages[stage].maxUs) latencyStages[stage].maxUs = us;
+}
+
+// Upper edge of the bucket holding the q-quantile, capped at the observed max
+ulong LatencyPercentile(int stage, double q) {
+   ulong count = latencyStages[stage].count;
+   if (count == 0) return 0;
+   
+   ulong rank = (ulong)MathCeil(q * count);
+   ulong seen = 0;
+   for (int b = 0; b < LATENCY_BUCKETS; b++) {
+      seen += latencyStages[stage].buckets[b];
+      if (seen >= rank) return MathMin((ulong)1 << (b + 1), latencyStages[stage].maxUs);
    }
+   return latencyStages[stage].maxUs;
+}
+
+string LatencyStageName(int stage) {
+   switch (stage) {
+      case LAT_POST_TO_FETCH:   return "post_to_fetch";
+      case LAT_FETCH:           return "fetch";
+      case LAT_PARSE:           return "parse";
+      case LAT_VALIDATE:        return "validate";
+      case LAT_LEG_SEND_TO_ACK: return "leg_send_to_ack";
+      case LAT_FETCH_TO_LIVE:   return "fetch_to_live";
+      case LAT_ACK_TO_FILL:     return "ack_to_fill";
+      case LAT_POST_TO_FILL:    return "post_to_fill";
+   }
+   return "unknown";
+}
+
+// Stages known once every leg is acknowledged
+void RecordPlacementLatency(SignalSlot &slot) {
+   SignalTrace t = slot.trace;
+   if (t.fetchStartUs == 0) return; // Simulated signal, nothing to trace
+   
+   if (t.postedMs > 0) RecordLatency(LAT_POST_TO_FETCH, (t.fetchWallMs - t.postedMs) * 1000);
+   RecordLatency(LAT_FETCH, (long)(t.fetchDoneUs - t.fetchStartUs));
+   RecordLatency(LAT_PARSE, (long)(t.parseDoneUs - t.fetchDoneUs));
+   RecordLatency(LAT_VALIDATE, (long)(t.validateDoneUs - t.parseDoneUs));
+   
+   ulong lastAck = 0;
+   for (int i = 0; i < slot.legCount; i++) {
+      if (slot.legs[i].ackUs == 0) continue;
+      RecordLatency(LAT_LEG_SEND_TO_ACK, (long)(slot.legs[i].ackUs - slot.legs[i].sentUs));
+      if (slot.legs[i].ackUs > lastAck) lastAck = slot.legs[i].ackUs;
+   }
+   if (lastAck > 0) RecordLatency(LAT_FETCH_TO_LIVE, (long)(lastAck - t.fetchStartUs));
+}
+
+void RecordFillLatency(SignalSlot &slot, int leg) {
+   ulong fillUs = slot.legs[leg].fillUs;
+   if (slot.legs[leg].ackUs > 0) RecordLatency(LAT_ACK_TO_FILL, (long)(fillUs - slot.legs[leg].ackUs));
+   
+   if (slot.trace.fetchStartUs > 0 && slot.trace.postedMs > 0) {
+      long fillWallMs = slot.trace.fetchWallMs + (long)(fillUs - slot.trace.fetchStartUs) / 1000;
+      RecordLatency(LAT_POST_TO_FILL, (fillWallMs - slot.trace.postedMs) * 1000);
+   }
+}
+
+// Per-signal trace for the placed status event, in microseconds from fetch
+string FormatSignalTrace(SignalSlot &slot) {
+   SignalTrace t = slot.trace;
+   if (t.fetchStartUs == 0) return "";
+   
+   string json = "{\"post_to_fetch_ms\":" + (t.postedMs > 0 ? IntegerToString(t.fetchWallMs - t.postedMs) : "null") +
+                 ",\"fetch_us\":" + IntegerToString(t.fetchDoneUs - t.fetchStartUs) +
+                 ",\"parse_us\":" + IntegerToString(t.parseDoneUs - t.fetchDoneUs) +
+                 ",\"validate_us\":" + IntegerToString(t.validateDoneUs - t.parseDoneUs) + ",\"legs\":[";
+   for (int i = 0; i < slot.legCount; i++) {
+      json += (i > 0 ? "," : "") + "{\"send_us\":" + IntegerToString(slot.legs[i].sentUs - t.fetchStartUs) +
+              ",\"ack_us\":" + (slot.legs[i].ackUs > 0 ? IntegerToString(slot.legs[i].ackUs - t.fetchStartUs) : "null") + "}";
+   }
+   return json + "]}";
+}
+
+// Histogram summary attached to every status POST
+string FormatLatencySummary() {
+   string json = "[";
+   bool first = true;
+   for (int s = 0; s < LAT_STAGE_COUNT; s++) {
+      if (latencyStages[s].count == 0) continue;
+      json += (first ? "" : ",") + "{\"stage\":\"" + LatencyStageName(s) + "\"" +
+              ",\"count\":" + IntegerToString(latencyStages[s].count) +
+              ",\"p50_us\":" + IntegerToString(LatencyPercentile(s, 0.50)) +
+              ",\"p99_us\":" + IntegerToString(LatencyPercentile(s, 0.99)) +
+              ",\"max_us\":" + IntegerToString(latencyStages[s].maxUs) + "}";
+      first = false;
+   }
+   return json + "]";
+}
+
+// Append one row per stage to LatencyCsvFile
+void DumpLatencyCsv() {
+   if (LatencyCsvFile == "") return;
+   
+   bool any = false;
+   for (int s = 0; s < LAT_STAGE_COUNT; s++) if (latencyStages[s].count > 0) any = true;
+   if (!any) return;
+   
+   int handle = FileOpen(LatencyCsvFile, FILE_READ | FILE_WRITE | FILE_CSV | FILE_ANSI | FILE_SHARE_READ, ',');
+   if (handle == INVALID_HANDLE) {
+      LogWarn("Failed to open " + LatencyCsvFile + ". Error: " + IntegerToString(GetLastError()));
+      return;
+   }
+   
+   if (FileSize(handle) == 0) {
+      FileWrite(handle, "time", "stage", "count", "p50_us", "p99_us", "max_us", "mean_us");
+   }
+   FileSeek(handle, 0, SEEK_END);
+   
+   string now = TimeToString(TimeCurrent(), TIME_DATE | TIME_SECONDS);
+   for (int s = 0; s < LAT_STAGE_COUNT; s++) {
+      ulong count = latencyStages[s].count;
+      if (count == 0) continue;
+      FileWrite(handle, now, LatencyStageName(s), count, LatencyPercentile(s, 0.50), LatencyPercentile(s, 0.99),
+                latencyStages[s].maxUs, latencyStages[s].sumUs / count);
+   }
+   FileClose(handle);
+}
+
+// Parse an ISO-8601 style timestamp ("2025-01-15T10:30:45" or "2025.01.15 10:30:45")
+// to UTC. A "Z" suffix or none means UTC already; a "+hh:mm"/"-hh:mm" (or
+// "+hhmm", "+hh") offset is taken off. Anything else after the seconds and
+// their fraction makes the timestamp unusable.
+datetime ParseSignalTime(string ts) {
+   int len = StringLen(ts);
+   if (len < 19) return 0;
+   
+   MqlDateTime t;
+   t.year = (int)StringToInteger(StringSubstr(ts, 0, 4));
+   t.mon  = (int)StringToInteger(StringSubstr(ts, 5, 2));
+   t.day  = (int)StringToInteger(StringSubstr(ts, 8, 2));
+   t.hour = (int)StringToInteger(StringSubstr(ts, 11, 2));
+   t.min  = (int)StringToInteger(StringSubstr(ts, 14, 2));
+   t.sec  = (int)StringToInteger(StringSubstr(ts, 17, 2));
+   
+   if (t.year < 2000 || t.mon < 1 || t.mon > 12 || t.day < 1 || t.day > 31) return 0;
+   
+   int k = 19;
+   if (k < len && StringGetCharacter(ts, k) == '.') {
+      for (k++; k < len; k++) {
+         ushort ch = StringGetCharacter(ts, k);
+         if (ch < '0' || ch > '9') break;
+      }
+   }
+   
+   long offsetSeconds = 0;
+   if (k < len) {
+      ushort designator = StringGetCharacter(ts, k);
+      if (designator == 'Z' || designator == 'z') {
+         if (k + 1 != len) return 0;
+      } else if (designator == '+' || designator == '-') {
+         string zone = StringSubstr(ts, k + 1);
+         if (StringLen(zone) == 5 && StringGetCharacter(zone, 2) == ':') zone = StringSubstr(zone, 0, 2) + StringSubstr(zone, 3);
+         int zoneLen = StringLen(zone);
+         if (zoneLen != 2 && zoneLen != 4) return 0;
+         for (int z = 0; z < zoneLen; z++) {
+            ushort ch = StringGetCharacter(zone, z);
+            if (ch < '0' || ch > '9') return 0;
+         }
+         long hours = StringToInteger(StringSubstr(zone, 0, 2));
+         long minutes = zoneLen == 4 ? StringToInteger(StringSubstr(zone, 2, 2)) : 0;
+         if (hours > 23 || minutes > 59) return 0;
+         offsetSeconds = (hours * 3600 + minutes * 60) * (designator == '-' ? -1 : 1);
+      } else {
+         return 0;
+      }
+   }
+   return (datetime)((long)StructToTime(t) - offsetSeconds);
+}
+
+// Same, in milliseconds, keeping a ".123" fraction when the producer sends one
+long ParseSignalTimeMs(string ts) {
+   datetime seconds = ParseSignalTime(ts);
+   if (seconds == 0) return 0;
+   
+   long ms = (long)seconds * 1000;
+   if (StringLen(ts) > 20 && StringGetCharacter(ts, 19) == '.') {
+      long scale = 100;
+      for (int k = 20; k < StringLen(ts) && scale > 0; k++) {
+         ushort ch = StringGetCharacter(ts, k);
+         if (ch < '0' || ch > '9') break;
+         ms += (ch - '0') * scale;
+         scale /= 10;
+      }
+   }
+   return ms;
+}
+
+// Millisecond UTC wall clock. TimeGMT() only has whole seconds, so it is
+// anchored to the microsecond counter at a second boundary (AnchorWallClock,
+// once at init) and read through that. If the two drift more than a second
+// apart (clock sync, sleep) the anchor is reset.
+void AnchorWallClock() {
+   long start = (long)TimeGMT();
+   ulong deadline = GetMicrosecondCount() + 1100000;
+   while ((long)TimeGMT() == start && GetMicrosecondCount() < deadline) {}
+   wallAnchorUs = GetMicrosecondCount();
+   wallAnchorMs = (long)TimeGMT() * 1000;
+}
+
+long WallClockMs() {
+   long ms = wallAnchorMs + (long)((GetMicrosecondCount() - wallAnchorUs) / 1000);
+   long gmt = (long)TimeGMT();
+   if (wallAnchorUs == 0 || ms / 1000 < gmt - 1 || ms / 1000 > gmt + 1) {
+      wallAnchorUs = GetMicrosecondCount();
+      wallAnchorMs = gmt * 1000;
+      ms = wallAnchorMs;
+   }
+   return ms;
 }
 
 // NEW: Make HTTP request to webhook URL
-bool MakeWebRequest(string &response, string webhookUrl) {
+// Conditional GET: the cursor goes in ?since= and the last ETag in
+// If-None-Match, so a backend with nothing new answers 204 or 304 with no
+// body. Returns the HTTP status (-1 on transport errors); response is only
+// filled on 200.
+int MakeWebRequest(string &response, string webhookUrl, string queryParams = "") {
    string headers = "Content-Type: application/json\r\n";
    headers += "Authorization: Bearer " + WebhookToken + "\r\n";
+   if (pollETag != "") headers += "If-None-Match: " + pollETag + "\r\n";
    
    char data[];
    char result[];
@@ -127,575 +1248,3579 @@ bool MakeWebRequest(string &response, string webhookUrl) {
    // Prepare request URL with timestamp to get latest signal
    string requestUrl = webhookUrl + "?timestamp=" + IntegerToString(TimeCurrent());
 
-   // if (queryParams != "")
-   //    requestUrl += "&" + queryParams;
+   if (queryParams != "")
+      requestUrl += "&" + queryParams;
 
    int timeout = 5000; // 5 second timeout
    int res = WebRequest("GET", requestUrl, headers, timeout, data, result, resultHeaders);
    
    if (res == -1) {
       int error = GetLastError();
-      LogMessage("WebRequest failed. Error: " + IntegerToString(error));
-      LogMessage("Make sure URL '" + requestUrl + "' is added to allowed URLs in Tools->Options->Expert Advisors");
-      return false;
+      LogError("WebRequest failed. Error: " + IntegerToString(error));
+      LogWarn("Make sure URL '" + requestUrl + "' is added to allowed URLs in Tools->Options->Expert Advisors");
+      return -1;
    }
    
+   // Nothing new: no body to convert, nothing to log
+   if (res == 204 || res == 304) return res;
+   
    if (res == 200) {
       response = CharArrayToString(result);
-      LogMessage("Received response: " + response);
-      return true;
+      pollETag = HttpHeaderValue(resultHeaders, "etag");
+      LogDebug("Received response: " + response);
    } else {
-      LogMessage("HTTP request failed with code: " + IntegerToString(res));
-      return false;
+      LogError("HTTP request failed with code: " + IntegerToString(res));
    }
+   return res;
 }
 
-// NEW: Process incoming webhook signal
-bool ProcessWebhookSignal(string jsonData) {
-   if (StringLen(jsonData) == 0) {
-      return false; // No data received
+// Value of a response header, matched case-insensitively; "" if absent
+string HttpHeaderValue(string headers, string name) {
+   string lines[];
+   int n = StringSplit(headers, '\n', lines);
+   int nameLen = StringLen(name);
+   
+   for (int i = 0; i < n; i++) {
+      string key = StringSubstr(lines[i], 0, nameLen);
+      StringToLower(key);
+      if (key != name || StringGetCharacter(lines[i], nameLen) != ':') continue;
+      
+      string value = StringSubstr(lines[i], nameLen + 1);
+      StringTrimLeft(value);
+      StringTrimRight(value);
+      return value;
+   }
+   return "";
+}
+
+// Push channel. One TCP connection to the local signal service carries
+// length-prefixed frames: 4-byte big-endian length (type byte + payload),
+// then a type byte and the payload. The EA opens with a HELLO carrying the
+// token and its cursor. The service pushes SIGNAL frames whose payload is the
+// same JSON the GET endpoint returns. Both sides send HEARTBEAT frames, and a
+// link that has been silent for three heartbeat intervals is dropped and
+// redialled with backoff. While the link is down, HTTP polling takes over.
+// Returns true while the link is up.
+bool PushPump() {
+   ulong now = GetTickCount64();
+   ulong heartbeatMs = (ulong)MathMax(PushHeartbeatSeconds, 1) * 1000;
+   
+   if (pushSocket == INVALID_HANDLE) {
+      if (now < pushNextConnectMs) return false;
+      if (!PushConnect()) {
+         pushBackoffMs = (uint)MathMin(MathMax(pushBackoffMs * 2, 500), 30000);
+         pushNextConnectMs = now + pushBackoffMs;
+         return false;
+      }
+      pushBackoffMs = 0;
    }
    
-   SignalParams newSignal;
-   if (!ParseSignalFromJSON(jsonData, newSignal)) {
-      LogMessage("Failed to parse signal from JSON");
+   if (!SocketIsConnected(pushSocket)) {
+      PushDisconnect("connection closed by peer");
       return false;
    }
    
+   uint readable = SocketIsReadable(pushSocket);
+   if (readable > 0) pushLastRxMs = now;
+   
+   // With the intake queue full leave pending frames in the socket; pending
+   // bytes still count as a sign of life
+   if (readable > 0 && IntakeHasRoom()) {
+      uchar chunk[];
+      int got = SocketRead(pushSocket, chunk, readable, 10);
+      if (got < 0) {
+         PushDisconnect("read error " + IntegerToString(GetLastError()));
+         return false;
+      }
+      int have = ArraySize(pushRx);
+      ArrayResize(pushRx, have + got, 4096);
+      ArrayCopy(pushRx, chunk, have, 0, got);
+   }
+   // Frames held back while the queue was full go out once it has room
+   if (ArraySize(pushRx) > 0 && IntakeHasRoom() && !PushDispatchFrames()) return false;
+   
+   if (now - pushLastTxMs >= heartbeatMs) PushSendFrame(PUSH_FRAME_HEARTBEAT, "");
+   if (pushSocket != INVALID_HANDLE && now - pushLastRxMs > 3 * heartbeatMs) {
+      PushDisconnect("no heartbeat for " + IntegerToString(now - pushLastRxMs) + " ms");
+      return false;
+   }
+   
+   return pushSocket != INVALID_HANDLE;
+}
+
+bool PushConnect() {
+   pushSocket = SocketCreate();
+   if (pushSocket == INVALID_HANDLE) {
+      LogError("Push channel: SocketCreate failed. Error: " + IntegerToString(GetLastError()));
+      return false;
+   }
+   
+   if (!SocketConnect(pushSocket, PushHost, PushPort, 500)) {
+      if (pushBackoffMs == 0) {
+         LogWarn("Push channel: cannot connect to " + PushHost + ":" + IntegerToString(PushPort) + ". Error: " +
+                 IntegerToString(GetLastError()) + ". Falling back to HTTP polling.");
+      }
+      SocketClose(pushSocket);
+      pushSocket = INVALID_HANDLE;
+      return false;
+   }
+   
+   ArrayResize(pushRx, 0);
+   pushLastRxMs = GetTickCount64();
+   if (!PushSendFrame(PUSH_FRAME_HELLO, "token=" + WebhookToken + "&since=" + IntegerToString(signalCursor))) return false;
+   
+   LogMessage("Push channel connected to " + PushHost + ":" + IntegerToString(PushPort));
+   return true;
+}
+
+void PushDisconnect(string reason) {
+   if (pushSocket == INVALID_HANDLE) return;
+   
+   SocketClose(pushSocket);
+   pushSocket = INVALID_HANDLE;
+   ArrayResize(pushRx, 0);
+   pushNextConnectMs = GetTickCount64() + 500;
+   LogWarn("Push channel down (" + reason + "), falling back to HTTP polling");
+}
+
+bool PushSendFrame(uchar type, string payload) {
+   if (pushSocket == INVALID_HANDLE) return false;
+   
+   uchar body[];
+   int n = payload == "" ? 0 : StringToCharArray(payload, body, 0, WHOLE_ARRAY, CP_UTF8) - 1; // Drop the terminator
+   uint length = (uint)n + 1;
+   
+   uchar frame[];
+   ArrayResize(frame, n + 5);
+   frame[0] = (uchar)(length >> 24);
+   frame[1] = (uchar)(length >> 16);
+   frame[2] = (uchar)(length >> 8);
+   frame[3] = (uchar)length;
+   frame[4] = type;
+   if (n > 0) ArrayCopy(frame, body, 5, 0, n);
+   
+   if (SocketSend(pushSocket, frame, n + 5) != n + 5) {
+      PushDisconnect("send error " + IntegerToString(GetLastError()));
+      return false;
+   }
+   pushLastTxMs = GetTickCount64();
+   return true;
+}
+
+// Handle every complete frame in pushRx and keep the partial tail
+bool PushDispatchFrames() {
+   int size = ArraySize(pushRx);
+   int pos = 0;
+   
+   while (size - pos >= 5) {
+      uint length = ((uint)pushRx[pos] << 24) | ((uint)pushRx[pos + 1] << 16) | ((uint)pushRx[pos + 2] << 8) | pushRx[pos + 3];
+      if (length == 0 || length > PUSH_MAX_FRAME) {
+         PushDisconnect("bad frame length " + IntegerToString(length));
+         return false;
+      }
+      if ((uint)(size - pos - 4) < length) break;
+      
+      uchar type = pushRx[pos + 4];
+      if (type == PUSH_FRAME_SIGNAL) {
+         ulong now = GetMicrosecondCount();
+         pollTrace.fetchWallMs = WallClockMs();
+         pollTrace.fetchStartUs = now;
+         pollTrace.fetchDoneUs = now;
+         
+         string json = CharArrayToString(pushRx, pos + 5, (int)length - 1, CP_UTF8);
+         ulong previous = lastPollMs;
+         lastPollMs = GetTickCount64();
+         ProcessWebhookSignal(json, previous);
+         JournalCursor();
+         
+         // The intake queue filled up: keep this frame and the ones after it
+         // and dispatch them again once there is room. Signals of the frame
+         // already consumed are behind signalCursor or deduped by id.
+         if (signalsDeferred) break;
+         pushSignalFrames++;
+      }
+      pos += 4 + (int)length;
+   }
+   
+   if (pos > 0) {
+      uchar tail[];
+      int rest = ArrayCopy(tail, pushRx, 0, pos, size - pos);
+      ArrayResize(pushRx, rest, 4096);
+      if (rest > 0) ArrayCopy(pushRx, tail, 0, 0, rest);
+   }
+   return true;
+}
+
+// Signal journal transport. The forwarder on the same host (or the fan-out
+// leader, see below) appends fixed-size checksummed records to a journal in
+// the Common files folder and the EA tails it by offset every timer pass; no
+// network stack is involved. A record that does not check out yet at the tail
+// is a write in progress (or a torn write the writer replaces on restart) and
+// is read again on the next pass. feedCursor counts the records consumed and
+// is persisted by the state journal, held behind signals still queued.
+string FeedFileName() {
+   return SignalJournalFile != "" ? SignalJournalFile : FanoutJournalFile;
+}
+
+bool FeedOpen() {
+   feedFile = FileOpen(FeedFileName(), FILE_READ | FILE_BIN | FILE_COMMON | FILE_SHARE_READ | FILE_SHARE_WRITE);
+   if (feedFile == INVALID_HANDLE) return false;
+   
+   LogMessage("Signal journal " + FeedFileName() + " opened at record " + IntegerToString(feedCursor + 1));
+   return true;
+}
+
+bool FeedRecordValid(const uchar &bytes[], long seq, FeedRecord &rec) {
+   CharArrayToStruct(rec, bytes);
+   return rec.magic == FEED_RECORD_MAGIC && rec.seq == seq && rec.checksum == JournalChecksum(bytes, sizeof(FeedRecord) - 4);
+}
+
+void FeedPump() {
+   if (feedFile == INVALID_HANDLE) {
+      // The writer may not have created the file yet
+      if (GetTickCount64() < feedNextOpenMs) return;
+      feedNextOpenMs = GetTickCount64() + 1000;
+      if (!FeedOpen()) return;
+   }
+   
+   int size = sizeof(FeedRecord);
+   ulong fileSize = FileSize(feedFile);
+   if (fileSize < (ulong)feedCursor * size) {
+      LogWarn("Signal journal is shorter than the read offset; reading it again from the start");
+      feedCursor = 0;
+   }
+   if ((ulong)(feedCursor + 1) * size > fileSize) return;
+   
+   ulong now = GetMicrosecondCount();
+   pollTrace.fetchWallMs = WallClockMs();
+   pollTrace.fetchStartUs = now;
+   pollTrace.fetchDoneUs = now;
+   ulong previous = lastPollMs;
+   lastPollMs = GetTickCount64();
+   
+   uchar bytes[];
+   while ((ulong)(feedCursor + 1) * size <= fileSize && IntakeHasRoom()) {
+      FileSeek(feedFile, feedCursor * size, SEEK_SET);
+      FeedRecord rec;
+      if (FileReadArray(feedFile, bytes, 0, size) != size) break;
+      
+      if (!FeedRecordValid(bytes, feedCursor + 1, rec)) {
+         // Appends are sequential, so a bad record with data after it will
+         // never be completed
+         if ((ulong)(feedCursor + 2) * size > fileSize) break;
+         feedCorrupt++;
+         LogWarn("Skipping corrupt signal journal record " + IntegerToString(feedCursor + 1));
+         feedCursor++;
+         continue;
+      }
+      
+      SignalParams sig;
+      sig.signal = rec.direction > 0 ? "BUY" : (rec.direction < 0 ? "SELL" : "");
+      sig.entry = rec.entry;
+      sig.sl = rec.sl;
+      sig.tp1 = rec.tp1;
+      sig.tp2 = rec.tp2;
+      sig.timestamp = rec.postedMs > 0 ? TimeToString((datetime)(rec.postedMs / 1000), TIME_DATE | TIME_SECONDS) +
+                                         StringFormat(".%03d", (int)(rec.postedMs % 1000)) : "";
+      sig.symbol = CharArrayToString(rec.symbol);
+      sig.id = CharArrayToString(rec.id);
+      sig.seq = rec.feedSeq;
+      sig.journalSeq = rec.seq;
+      sig.command = rec.direction == 0 ? "flatten" : "";
+      
+      // A record the intake queue refuses is read again on the next pump
+      signalsDeferred = false;
+      if (CompleteParsedSignal(sig)) HandleParsedSignal(sig, previous);
+      if (signalsDeferred) break;
+      feedCursor++;
+      feedRecords++;
+      
+      // Followers track the upstream cursor too, so after a failover the new
+      // leader resumes polling where the old one stopped
+      if (sig.seq > signalCursor) signalCursor = sig.seq;
+   }
+   JournalCursor();
+}
+
+// Leader/follower fan-out. Every instance sharing FanoutJournalFile competes
+// for an exclusive handle on "<file>.lock"; the operating system releases it
+// when the holder's terminal exits, so a follower takes over within one
+// election interval. The leader polls the feed as usual and appends each new
+// signal to the journal before executing it; followers only tail the journal.
+bool FanoutLeader() {
+   return fanoutLock != INVALID_HANDLE;
+}
+
+void FanoutElect() {
+   if (FanoutLeader() || GetTickCount64() < fanoutNextElectMs) return;
+   fanoutNextElectMs = GetTickCount64() + 1000;
+   
+   int lock = FileOpen(FanoutJournalFile + ".lock", FILE_WRITE | FILE_BIN | FILE_COMMON);
+   if (lock == INVALID_HANDLE) return; // Another instance leads
+   
+   // Consume whatever the previous leader published before taking over
+   FeedPump();
+   
+   int writer = FileOpen(FanoutJournalFile, FILE_READ | FILE_WRITE | FILE_BIN | FILE_COMMON | FILE_SHARE_READ);
+   if (writer == INVALID_HANDLE) {
+      LogError("Fan-out: cannot open " + FanoutJournalFile + " for writing. Error: " + IntegerToString(GetLastError()));
+      FileClose(lock);
+      return;
+   }
+   
+   // Append after the last whole record; a torn tail gets overwritten
+   int size = sizeof(FeedRecord);
+   long seq = (long)(FileSize(writer) / size);
+   uchar bytes[];
+   FeedRecord rec;
+   while (seq > 0) {
+      FileSeek(writer, (seq - 1) * size, SEEK_SET);
+      if (FileReadArray(writer, bytes, 0, size) == size && FeedRecordValid(bytes, seq, rec)) break;
+      seq--;
+   }
+   
+   // Records the queue had no room for yet: stay a follower until they are in
+   if (feedCursor < seq) {
+      FileClose(writer);
+      FileClose(lock);
+      return;
+   }
+   
+   fanoutLock = lock;
+   fanoutWriter = writer;
+   fanoutSeq = seq;
+   FileWriteLong(fanoutLock, (long)AccountInfoInteger(ACCOUNT_LOGIN));
+   FileFlush(fanoutLock);
+   
+   if (feedFile != INVALID_HANDLE) FileClose(feedFile);
+   feedFile = INVALID_HANDLE;
+   feedCursor = fanoutSeq;
+   JournalCursor();
+   LogMessage("Fan-out: this instance is now the leader, publishing from record " + IntegerToString(fanoutSeq + 1) +
+              ", feed cursor " + IntegerToString(signalCursor));
+}
+
+// Called by the leader for every new signal, before it is queued locally.
+// Returns the journal seq it was published as, 0 if the write failed.
+long FanoutPublish(SignalParams &sig) {
+   FeedRecord rec;
+   ZeroMemory(rec);
+   rec.magic = FEED_RECORD_MAGIC;
+   rec.seq = fanoutSeq + 1;
+   rec.feedSeq = sig.seq;
+   rec.postedMs = ParseSignalTimeMs(sig.timestamp);
+   // Direction 0 is the flatten command, the only one the journal carries
+   rec.direction = (char)(sig.command != "" ? 0 : (sig.signal == "BUY" ? 1 : -1));
+   rec.entry = sig.entry;
+   rec.sl = sig.sl;
+   rec.tp1 = sig.tp1;
+   rec.tp2 = sig.tp2;
+   // The default instrument goes out as "", so each follower maps it to its
+   // own first TradeSymbols entry (broker symbol names differ)
+   StringToCharArray(sig.symbol == symbolSpecs[0].name ? "" : sig.symbol, rec.symbol, 0, FEED_SYMBOL_LEN - 1);
+   StringToCharArray(sig.id, rec.id, 0, FEED_ID_LEN - 1);
+   
+   uchar bytes[];
+   StructToCharArray(rec, bytes);
+   rec.checksum = JournalChecksum(bytes, sizeof(FeedRecord) - 4);
+   StructToCharArray(rec, bytes);
+   
+   // One write per record, so followers never see it half-written for long
+   FileSeek(fanoutWriter, fanoutSeq * sizeof(FeedRecord), SEEK_SET);
+   if (FileWriteArray(fanoutWriter, bytes) != (uint)ArraySize(bytes)) {
+      LogError("Fan-out: failed to publish " + sig.id + ". Error: " + IntegerToString(GetLastError()));
+      return 0;
+   }
+   FileFlush(fanoutWriter);
+   fanoutSeq++;
+   fanoutPublished++;
+   
+   // The leader has consumed its own record; after a restart as a follower it
+   // continues from here. Records still in the intake queue carry their
+   // journalSeq, so the journaled cursor stays behind them.
+   feedCursor = fanoutSeq;
+   return fanoutSeq;
+}
+
+// Outbound status queue. Trading code only appends to a fixed ring; OnTimer
+// posts the queued events to WebhookUpdateURL in batches. WebRequest is
+// synchronous in MQL5, so flushing stays off the placement and tick paths,
+// uses a short timeout, and backs off while the backend is unreachable.
+void QueueStatusEvent(ENUM_STATUS_EVENT type, SignalSlot &slot, int leg, double price, double sl) {
+   if (statusCount == STATUS_QUEUE_SIZE) {
+      // Full: drop the oldest event rather than block or grow
+      statusHead = (statusHead + 1) % STATUS_QUEUE_SIZE;
+      statusCount--;
+      statusDropped++;
+   }
+   
+   int i = (statusHead + statusCount) % STATUS_QUEUE_SIZE;
+   statusQueue[i].type = type;
+   statusQueue[i].signalId = SignalIdOf(slot.sig.id);
+   statusQueue[i].symbol = symbolSpecs[slot.sym].name;
+   statusQueue[i].digits = symbolSpecs[slot.sym].digits;
+   statusQueue[i].ticket = leg >= 0 ? slot.legs[leg].ticket : 0;
+   statusQueue[i].leg = leg + 1;
+   statusQueue[i].price = price;
+   statusQueue[i].sl = sl;
+   statusQueue[i].tp = leg >= 0 ? slot.legs[leg].tp : 0;
+   statusQueue[i].time = TimeCurrent();
+   statusQueue[i].trace = "";
+   statusCount++;
+}
+
+void FlushStatusQueue(bool final = false) {
+   if (statusCount == 0 || WebhookUpdateURL == "") return;
+   
+   ulong now = GetTickCount64();
+   if (now < nextStatusFlushMs) return;
+   
+   // Never compete with an order placement that is still in flight, nor
+   // hold up a queued signal the next pass can hand to a free slot. A queue
+   // waiting on busy slots (or a flatten) would otherwise stall the POST.
+   bool drainPending = intakeCount > 0 && HasFreeSlot() && !flattenActive;
+   if (!final && (asyncPlacementsInFlight > 0 || drainPending)) return;
+   
+   int batch = (int)MathMin(statusCount, MathMax(StatusBatchSize, 1));
+   string body = "{\"events\":[";
+   for (int k = 0; k < batch; k++) {
+      int i = (statusHead + k) % STATUS_QUEUE_SIZE;
+      body += (k > 0 ? "," : "") +
+              "{\"type\":\"" + StatusEventName(statusQueue[i].type) + "\"" +
+              ",\"signal_id\":\"" + JsonEscape(statusQueue[i].signalId) + "\"" +
+              ",\"leg\":" + IntegerToString(statusQueue[i].leg) +
+              ",\"ticket\":" + IntegerToString(statusQueue[i].ticket) +
+              ",\"symbol\":\"" + statusQueue[i].symbol + "\"" +
+              ",\"price\":" + DoubleToString(statusQueue[i].price, statusQueue[i].digits) +
+              ",\"sl\":" + DoubleToString(statusQueue[i].sl, statusQueue[i].digits) +
+              ",\"tp\":" + DoubleToString(statusQueue[i].tp, statusQueue[i].digits) +
+              ",\"time\":" + IntegerToString(statusQueue[i].time) +
+              (statusQueue[i].trace != "" ? ",\"trace\":" + statusQueue[i].trace : "") + "}";
+   }
+   body += "],\"dropped\":" + IntegerToString(statusDropped) + ",\"latency\":" + FormatLatencySummary() +
+           ",\"dedup\":{\"hits\":" + IntegerToString(dedupHits) + ",\"misses\":" + IntegerToString(dedupMisses) +
+           ",\"expired\":" + IntegerToString(dedupExpired) + "}" +
+           ",\"polls\":{\"empty\":" + IntegerToString(pollsEmpty) + ",\"stale\":" + IntegerToString(pollsStale) +
+           ",\"useful\":" + IntegerToString(pollsUseful) + ",\"failed\":" + IntegerToString(pollsFailed) + "}" +
+           ",\"retries\":{\"attempts\":" + IntegerToString(retryAttempts) + ",\"recovered\":" +
+           IntegerToString(retrySignalsRecovered) + ",\"exhausted\":" + IntegerToString(retryExhausted) +
+           ",\"added_us\":" + IntegerToString(retryAddedUsSum) + "}" +
+           ",\"intake\":{\"queued\":" + IntegerToString(intakeCount) + ",\"executed\":" + IntegerToString(intakeExecuted) +
+           ",\"expired\":" + IntegerToString(intakeExpired) + ",\"overtaken\":" + IntegerToString(intakeOvertaken) +
+           ",\"wait_max_ms\":" + IntegerToString(intakeWaitMaxMs) + "}" +
+           ",\"flatten\":{\"runs\":" + IntegerToString(flattenRuns) + ",\"active\":" + (flattenActive ? "true" : "false") +
+           ",\"last_us\":" + IntegerToString(flattenLastUs) + ",\"requests\":" + IntegerToString(flattenRequests) +
+           ",\"left\":" + IntegerToString(flattenLastLeft) + "}}";
+   
+   // One POST per timer pass at most, with a short timeout: WebRequest blocks
+   if (!PostWebRequest(WebhookUpdateURL, body, (int)MathMax(MathMin(StatusTimeoutMs, STATUS_TIMEOUT_CAP_MS), 50))) {
+      statusBackoffMs = statusBackoffMs == 0 ? (uint)MathMax(StatusFlushIntervalMs, 100)
+                                             : (uint)MathMin(statusBackoffMs * 2, 60000);
+      nextStatusFlushMs = now + statusBackoffMs;
+      LogMessage("Status update failed, " + IntegerToString(statusCount) + " events queued, retry in " +
+                 IntegerToString(statusBackoffMs) + " ms");
+      return;
+   }
+   
+   statusHead = (statusHead + batch) % STATUS_QUEUE_SIZE;
+   statusCount -= batch;
+   statusDropped = 0;
+   statusBackoffMs = 0;
+   // Drain the rest on the next timer event when a backlog built up
+   nextStatusFlushMs = statusCount > 0 ? now : now + (ulong)MathMax(StatusFlushIntervalMs, 100);
+}
+
+string StatusEventName(ENUM_STATUS_EVENT type) {
+   switch (type) {
+      case STATUS_PLACED:    return "placed";
+      case STATUS_FILLED:    return "filled";
+      case STATUS_SL_MOVED:  return "sl_moved";
+      case STATUS_CLOSED:    return "closed";
+      case STATUS_CANCELLED: return "cancelled";
+   }
+   return "unknown";
+}
+
+string JsonEscape(string value) {
+   StringReplace(value, "\\", "\\\\");
+   StringReplace(value, "\"", "\\\"");
+   return value;
+}
+
+// POST a JSON body; used for status updates
+bool PostWebRequest(string url, string body, int timeoutMs) {
+   string headers = "Content-Type: application/json\r\n";
+   headers += "Authorization: Bearer " + WebhookToken + "\r\n";
+   
+   char data[];
+   char result[];
+   string resultHeaders;
+   
+   // Drop the terminating null StringToCharArray appends
+   int size = StringToCharArray(body, data, 0, WHOLE_ARRAY, CP_UTF8);
+   if (size > 0) ArrayResize(data, size - 1);
+   
+   int res = WebRequest("POST", url, headers, timeoutMs, data, result, resultHeaders);
+   if (res == -1) {
+      LogError("WebRequest failed. Error: " + IntegerToString(GetLastError()));
+      return false;
+   }
+   return res >= 200 && res < 300;
+}
+
+// NEW: Process incoming webhook signal
+// The GET endpoint returns either a single signal object (legacy) or a JSON
+// array of signal objects ordered oldest first. Each batched signal carries a
+// monotonically increasing "seq"; the EA sends the last consumed seq back as
+// ?since=<seq> so one round-trip returns everything it has not seen yet.
+bool ProcessWebhookSignal(string jsonData, ulong previousPollMs = 0) {
+   signalsDeferred = false;
+   int len = StringLen(jsonData);
+   int pos = 0;
+   JsonSkipWhitespace(jsonData, pos, len);
+   if (pos >= len) {
+      return false; // No data received
+   }
+   
+   if (StringGetCharacter(jsonData, pos) != '[') {
+      SignalParams newSignal;
+      if (!ParseSignalFromJSON(jsonData, pos, newSignal)) {
+         LogWarn("Failed to parse signal from JSON");
+         return false;
+      }
+      // Leave it on the feed rather than consume it and have it dropped
+      if (newSignal.command == "" && !IntakeHasRoom()) {
+         LogMessage("Signal intake queue full, deferring signal seq " + IntegerToString(newSignal.seq));
+         signalsDeferred = true;
+         return false;
+      }
+      bool handled = HandleParsedSignal(newSignal, previousPollMs);
+      if (newSignal.seq > signalCursor) signalCursor = newSignal.seq;
+      return handled;
+   }
+   
+   pos++;
+   bool anySuccess = false;
+   int consumed = 0;
+   
+   while (true) {
+      JsonSkipWhitespace(jsonData, pos, len);
+      if (pos >= len || StringGetCharacter(jsonData, pos) == ']') break;
+      
+      // Leave the rest on the feed once the intake queue is full
+      if (!IntakeHasRoom()) {
+         LogMessage("Signal intake queue full, deferring remaining batched signals after seq " + IntegerToString(signalCursor));
+         signalsDeferred = true;
+         break;
+      }
+      
+      SignalParams newSignal;
+      if (!TokenizeSignalJSON(jsonData, pos, newSignal)) {
+         LogWarn("Malformed signal batch near offset " + IntegerToString(pos));
+         break;
+      }
+      
+      if (newSignal.seq == 0 || newSignal.seq > signalCursor) {
+         if (CompleteParsedSignal(newSignal)) {
+            if (HandleParsedSignal(newSignal, previousPollMs)) anySuccess = true;
+            if (signalsDeferred) break;
+         } else {
+            LogWarn("Failed to parse signal from JSON");
+         }
+         if (newSignal.seq > signalCursor) signalCursor = newSignal.seq;
+         consumed++;
+      }
+      
+      JsonSkipWhitespace(jsonData, pos, len);
+      if (pos < len && StringGetCharacter(jsonData, pos) == ',') pos++;
+   }
+   
+   if (consumed > 1) {
+      LogMessage("Drained " + IntegerToString(consumed) + " batched signals, cursor now " + IntegerToString(signalCursor));
+   }
+   
+   return anySuccess;
+}
+
+// Dedup one parsed signal and queue it; execution happens in DrainIntakeQueue()
+bool HandleParsedSignal(SignalParams &newSignal, ulong previousPollMs) {
+   if (newSignal.command != "") return HandleFeedCommand(newSignal);
+   
+   SignalTrace trace = pollTrace;
+   trace.parseDoneUs = GetMicrosecondCount();
+   
    // Check if this is a new signal (avoid processing duplicates)
-   if (newSignal.id == lastProcessedSignalId) {
-      LogMessage("Signal already processed");
+   if (DedupSeen(newSignal.id)) {
+      LogFmt(LOG_LEVEL_INFO, "Signal %s already processed", 0, 0, 0, newSignal.id);
       return false; // Already processed this signal
    }
    
+   if (FindSlotBySignalId(newSignal.id) >= 0) {
+      LogFmt(LOG_LEVEL_INFO, "Signal %s is already being managed", 0, 0, 0, newSignal.id);
+      return false;
+   }
+   
+   if (FindQueuedSignal(newSignal.id) >= 0) {
+      LogFmt(LOG_LEVEL_INFO, "Signal %s is already queued", 0, 0, 0, newSignal.id);
+      return false;
+   }
+   
+   RecordSignalPickup(newSignal, previousPollMs);
+   
+   SignalRecord record;
+   if (!CompileSignal(newSignal, record)) return false;
+   trace.postedMs = record.postedMs;
+   
+   // Only what compiles and fits in the queue goes to the followers; the
+   // queued copy is tied to its record like one read from the journal
+   if (FanoutLeader() && IntakeHasRoom()) record.journalSeq = FanoutPublish(newSignal);
+   return EnqueueSignal(record, trace);
+}
+
+// Commands arrive on the same feed as signals, as {"command": ..., "page_id": ...}
+// objects, and are deduped by id like signals. The last one handled is also
+// kept in the state journal, so a command still on the feed after a restart
+// (a backend ignoring since=, a journal replayed from behind) is not repeated.
+bool HandleFeedCommand(SignalParams &cmd) {
+   if ((cmd.id != "" && (cmd.id == lastCommandId || DedupSeen(cmd.id))) || (cmd.seq > 0 && cmd.seq <= lastCommandSeq)) {
+      LogMessage("Command " + cmd.id + " already processed");
+      return false;
+   }
+   
+   if (cmd.command != "flatten") {
+      LogWarn("Unknown feed command: " + cmd.command);
+      return false;
+   }
+   
+   if (cmd.id != "") DedupRemember(cmd.id);
+   lastCommandId = cmd.id;
+   if (cmd.seq > lastCommandSeq) lastCommandSeq = cmd.seq;
+   JournalCursor();
+   if (FanoutLeader()) FanoutPublish(cmd);
+   return StartFlatten(cmd.id != "" ? cmd.id : "feed");
+}
+
+// Validate and trade one signal taken off the intake queue
+bool ExecuteSignal(SignalRecord &newSignal, SignalTrace &trace) {
    // Validate the parsed signal
    if (!ValidateSignalParams(newSignal)) {
-      LogMessage("Invalid signal parameters received");
+      LogWarn("Invalid signal parameters received");
+      return false;
+   }
+   trace.validateDoneUs = GetMicrosecondCount();
+   
+   string id = SignalIdOf(newSignal.id);
+   int index = AcquireSlot(newSignal);
+   if (index < 0) {
+      LogFmt(LOG_LEVEL_INFO, "No free signal slot for %s", 0, 0, 0, id);
       return false;
    }
    
    // Process the new signal
-   sig = newSignal;
-   lastProcessedSignalId = newSignal.id;
+   slots[index].trace = trace;
+   lastProcessedSignalId = id;
+   DedupRemember(id);
    
-   LogMessage("Processing new " + sig.signal + " signal (ID: " + sig.id + ")");
-   bool success = OpenSignalTrades(sig);
+   LogFmt(LOG_LEVEL_INFO, "Processing new %s signal (ID: %s)", 0, 0, 0, DirectionName(newSignal.direction), id);
+   bool success = OpenSignalTrades(slots[index]);
    
    if (success) {
-      LogMessage("Signal processed successfully");
+      LogPlacementOutcome(slots[index]);
    } else {
-      LogMessage("Failed to process signal");
+      ReleaseSlot(index);
+      LogWarn("Failed to process signal");
    }
    
    return success;
 }
 
+// Signal intake queue. Polling and the push channel keep pulling signals
+// while every slot is busy; they wait here in channel-timestamp order and are
+// executed oldest first as slots free up. Entries past SignalMaxAgeSeconds, or
+// whose entry the market has already run through, are dropped before they
+// reach validation.
+bool IntakeHasRoom() {
+   return intakeCount < INTAKE_QUEUE_SIZE;
+}
+
+int FindQueuedSignal(string signalId) {
+   int ref = FindInternedId(signalId);
+   if (ref < 0) return -1;
+   for (int i = 0; i < intakeCount; i++) {
+      if (intakeQueue[i].sig.id == ref) return i;
+   }
+   return -1;
+}
+
+bool EnqueueSignal(SignalRecord &newSignal, SignalTrace &trace) {
+   if (!IntakeHasRoom()) {
+      LogWarn("Signal intake queue full, leaving " + SignalIdOf(newSignal.id) + " on the feed");
+      signalsDeferred = true;
+      return false;
+   }
+   
+   long sortMs = newSignal.postedMs > 0 ? newSignal.postedMs : WallClockMs();
+   
+   // Insertion sort from the tail: signals almost always arrive in order
+   int pos = intakeCount;
+   while (pos > 0 && intakeQueue[pos - 1].sortMs > sortMs) {
+      intakeQueue[pos] = intakeQueue[pos - 1];
+      pos--;
+   }
+   intakeQueue[pos].sig = newSignal;
+   intakeQueue[pos].trace = trace;
+   intakeQueue[pos].sortMs = sortMs;
+   intakeQueue[pos].queuedMs = GetTickCount64();
+   intakeCount++;
+   
+   if (intakeCount > 1 || !HasFreeSlot()) {
+      LogFmt(LOG_LEVEL_INFO, "Queued signal %s (%i waiting)", intakeCount, 0, 0, SignalIdOf(newSignal.id));
+   }
+   return true;
+}
+
+void IntakeRemoveAt(int pos) {
+   for (int i = pos; i < intakeCount - 1; i++) intakeQueue[i] = intakeQueue[i + 1];
+   intakeCount--;
+}
+
+// Lowest feed seq still waiting in the queue, minus one; the journal records
+// this so a restart fetches queued signals again instead of skipping them
+long IntakeSafeCursor() {
+   long cursor = signalCursor;
+   for (int i = 0; i < intakeCount; i++) {
+      if (intakeQueue[i].sig.seq > 0 && intakeQueue[i].sig.seq - 1 < cursor) cursor = intakeQueue[i].sig.seq - 1;
+   }
+   return cursor;
+}
+
+// Same for the signal journal: the record before the oldest one still queued
+long IntakeSafeFeedCursor() {
+   long cursor = feedCursor;
+   for (int i = 0; i < intakeCount; i++) {
+      if (intakeQueue[i].sig.journalSeq > 0 && intakeQueue[i].sig.journalSeq - 1 < cursor) cursor = intakeQueue[i].sig.journalSeq - 1;
+   }
+   return cursor;
+}
+
+// Stale when older than SignalMaxAgeSeconds, or when the quote has already
+// traded through the entry (limits), slipped past it by more than
+// IntakeSlippagePoints (market orders), or reached TP1 or the SL
+bool IntakeIsStale(IntakeEntry &e, long nowMs) {
+   long maxAgeMs = (long)MathMax(SignalMaxAgeSeconds, 1) * 1000;
+   if (nowMs - e.sortMs > maxAgeMs) {
+      intakeExpired++;
+      LogFmt(LOG_LEVEL_WARN, "Dropping signal %s: %i s old", (nowMs - e.sortMs) / 1000, 0, 0, SignalIdOf(e.sig.id));
+      return true;
+   }
+   
+   int sym = e.sig.sym;
+   MqlTick tick;
+   if (!SymbolInfoTick(symbolSpecs[sym].name, tick)) return false;
+   
+   long dir = e.sig.direction;
+   double quote = dir > 0 ? tick.ask : tick.bid;      // Side the entry fills on
+   long quotePts = PriceToPoints(sym, quote);
+   long markPts = PriceToPoints(sym, dir > 0 ? tick.bid : tick.ask); // Side TP and SL trigger on
+   bool passed;
+   if (UseLimitOrders) {
+      passed = (quotePts - e.sig.entry) * dir <= 0;
+   } else {
+      passed = (quotePts - e.sig.entry) * dir > IntakeSlippagePoints;
+   }
+   passed = passed || (markPts - e.sig.tp1) * dir >= 0 || (markPts - e.sig.sl) * dir <= 0;
+   
+   if (passed) {
+      intakeOvertaken++;
+      LogFmt(LOG_LEVEL_WARN, "Dropping signal %s: market at %p has moved past the entry", 0, 0, quote, SignalIdOf(e.sig.id), "",
+             symbolSpecs[sym].digits);
+   }
+   return passed;
+}
+
+// Called every timer pass: expire stale entries, then execute from the head
+// while slots are free
+void DrainIntakeQueue() {
+   if (intakeCount == 0 || flattenActive) return;
+   
+   long nowMs = WallClockMs();
+   for (int i = intakeCount - 1; i >= 0; i--) {
+      if (IntakeIsStale(intakeQueue[i], nowMs)) IntakeRemoveAt(i);
+   }
+   
+   while (intakeCount > 0 && HasFreeSlot()) {
+      IntakeEntry e = intakeQueue[0];
+      IntakeRemoveAt(0);
+      
+      ulong waitMs = GetTickCount64() - e.queuedMs;
+      intakeWaitSumMs += waitMs;
+      if (waitMs > intakeWaitMaxMs) intakeWaitMaxMs = waitMs;
+      intakeExecuted++;
+      
+      ExecuteSignal(e.sig, e.trace);
+   }
+   JournalCursor();
+}
+
 // NEW: Parse signal from JSON data
-bool ParseSignalFromJSON(string jsonData, SignalParams &signal) {
-   // Reset signal structure
+bool ParseSignalFromJSON(const string &jsonData, int &pos, SignalParams &signal) {
+   if (!TokenizeSignalJSON(jsonData, pos, signal)) {
+      LogWarn("Malformed signal JSON near offset " + IntegerToString(pos));
+      return false;
+   }
+   
+   return CompleteParsedSignal(signal);
+}
+
+// Field checks and id fallback once the tokenizer has filled the struct
+bool CompleteParsedSignal(SignalParams &signal) {
+   // Commands carry no trade levels; HandleParsedSignal routes them
+   if (signal.command != "") {
+      if (signal.id == "" && signal.seq > 0) signal.id = signal.command + "-" + IntegerToString(signal.seq);
+      else if (signal.id == "" && signal.journalSeq > 0) signal.id = signal.command + "-j" + IntegerToString(signal.journalSeq);
+      return true;
+   }
+   
+   if (signal.signal == "") {
+      LogMessage("JSON missing 'signal' field");
+      return false;
+   }
+   
+   if (signal.signal != "BUY" && signal.signal != "SELL") {
+      LogWarn("Invalid signal type: " + signal.signal);
+      return false;
+   }
+   
+   // Validate required fields
+   if (signal.entry == 0 || signal.sl == 0 || signal.tp1 == 0 || signal.tp2 == 0) {
+      LogMessage("Missing required price levels in JSON");
+      return false;
+   }
+   
+   int sym = FindSymbolSpec(signal.symbol);
+   if (sym < 0) {
+      LogWarn("Signal for symbol " + signal.symbol + " which is not in TradeSymbols");
+      return false;
+   }
+   signal.symbol = symbolSpecs[sym].name;
+   int digits = symbolSpecs[sym].digits;
+   
+   if (signal.id == "") {
+      // Derive the ID from the content so a retried id-less signal dedups
+      signal.id = SignalContentId(signal, digits);
+   }
+   
+   LogFmtWide(LOG_LEVEL_INFO, "Parsed signal: %s %s Entry:%p SL:%p TP1:%p TP2:%p", 0, 0, 0, 0, 0,
+              signal.entry, signal.sl, signal.tp1, signal.tp2, signal.symbol, signal.signal, digits);
+   
+   return true;
+}
+
+// Single forward pass over one JSON object starting at or after pos. Only
+// top-level keys are matched, so "tp1" nested in another object or sitting
+// inside a string value is never picked up. Unknown members are skipped
+// without being copied. On return pos is just past the closing brace.
+bool TokenizeSignalJSON(const string &json, int &pos, SignalParams &signal) {
    signal.signal = "";
    signal.entry = 0;
    signal.sl = 0;
    signal.tp1 = 0;
    signal.tp2 = 0;
    signal.timestamp = "";
+   signal.symbol = "";
    signal.id = "";
+   signal.seq = 0;
+   signal.journalSeq = 0;
+   signal.command = "";
    
-   // Simple JSON parsing (you may want to use a more robust JSON library)
-   if (StringFind(jsonData, "\"signal\"") == -1) {
-      LogMessage("JSON missing 'signal' field");
-      return false;
-   }
+   int len = StringLen(json);
+   JsonSkipWhitespace(json, pos, len);
+   if (pos >= len || StringGetCharacter(json, pos) != '{') return false;
+   pos++;
    
-   // Extract signal type
-   signal.signal = ExtractJSONString(jsonData, "signal");
-   if (signal.signal != "BUY" && signal.signal != "SELL") {
-      LogMessage("Invalid signal type: " + signal.signal);
-      return false;
+   JsonSkipWhitespace(json, pos, len);
+   if (pos < len && StringGetCharacter(json, pos) == '}') {
+      pos++;
+      return true;
    }
    
-   // Extract price levels
-   signal.entry = ExtractJSONDouble(jsonData, "entry");
-   signal.sl = ExtractJSONDouble(jsonData, "sl");
-   signal.tp1 = ExtractJSONDouble(jsonData, "tp1");
-   signal.tp2 = ExtractJSONDouble(jsonData, "tp2");
+   while (pos < len) {
+      // Key
+      if (StringGetCharacter(json, pos) != '"') return false;
+      int keyStart = 0, keyEnd = 0;
+      bool keyEscaped = false;
+      if (!JsonScanString(json, pos, len, keyStart, keyEnd, keyEscaped)) return false;
+      
+      JsonSkipWhitespace(json, pos, len);
+      if (pos >= len || StringGetCharacter(json, pos) != ':') return false;
+      pos++;
+      JsonSkipWhitespace(json, pos, len);
+      if (pos >= len) return false;
+      
+      // Value
+      int field = keyEscaped ? SIGNAL_FIELD_NONE : JsonMatchSignalField(json, keyStart, keyEnd);
+      bool ok = true;
+      
+      switch (field) {
+         case SIGNAL_FIELD_SIGNAL:    ok = JsonReadString(json, pos, len, signal.signal); break;
+         case SIGNAL_FIELD_TIMESTAMP: ok = JsonReadString(json, pos, len, signal.timestamp); break;
+         case SIGNAL_FIELD_ID:        ok = JsonReadString(json, pos, len, signal.id); break;
+         case SIGNAL_FIELD_SYMBOL:    ok = JsonReadString(json, pos, len, signal.symbol); break;
+         case SIGNAL_FIELD_COMMAND:   ok = JsonReadString(json, pos, len, signal.command); break;
+         case SIGNAL_FIELD_ENTRY:     ok = JsonReadNumber(json, pos, len, signal.entry); break;
+         case SIGNAL_FIELD_SL:        ok = JsonReadNumber(json, pos, len, signal.sl); break;
+         case SIGNAL_FIELD_TP1:       ok = JsonReadNumber(json, pos, len, signal.tp1); break;
+         case SIGNAL_FIELD_TP2:       ok = JsonReadNumber(json, pos, len, signal.tp2); break;
+         case SIGNAL_FIELD_SEQ: {
+            double seq = 0;
+            ok = JsonReadNumber(json, pos, len, seq);
+            signal.seq = (long)seq;
+            break;
+         }
+         default:                     ok = JsonSkipValue(json, pos, len); break;
+      }
+      if (!ok) return false;
+      
+      JsonSkipWhitespace(json, pos, len);
+      if (pos >= len) return false;
+      
+      ushort ch = StringGetCharacter(json, pos);
+      pos++;
+      if (ch == '}') return true;
+      if (ch != ',') return false;
+      JsonSkipWhitespace(json, pos, len);
+   }
+   
+   return false;
+}
+
+// Compare the raw key in place against the known field names
+int JsonMatchSignalField(const string &json, int start, int end) {
+   int n = end - start;
+   ushort c0 = n > 0 ? StringGetCharacter(json, start) : 0;
+   
+   switch (c0) {
+      case 's':
+         if (JsonKeyEquals(json, start, n, "signal")) return SIGNAL_FIELD_SIGNAL;
+         if (JsonKeyEquals(json, start, n, "sl")) return SIGNAL_FIELD_SL;
+         if (JsonKeyEquals(json, start, n, "seq")) return SIGNAL_FIELD_SEQ;
+         if (JsonKeyEquals(json, start, n, "symbol")) return SIGNAL_FIELD_SYMBOL;
+         break;
+      case 'e':
+         if (JsonKeyEquals(json, start, n, "entry")) return SIGNAL_FIELD_ENTRY;
+         break;
+      case 't':
+         if (JsonKeyEquals(json, start, n, "tp1")) return SIGNAL_FIELD_TP1;
+         if (JsonKeyEquals(json, start, n, "tp2")) return SIGNAL_FIELD_TP2;
+         if (JsonKeyEquals(json, start, n, "timestamp")) return SIGNAL_FIELD_TIMESTAMP;
+         break;
+      case 'p':
+         if (JsonKeyEquals(json, start, n, "page_id")) return SIGNAL_FIELD_ID;
+         break;
+      case 'c':
+         if (JsonKeyEquals(json, start, n, "command")) return SIGNAL_FIELD_COMMAND;
+         break;
+   }
+   return SIGNAL_FIELD_NONE;
+}
+
+bool JsonKeyEquals(const string &json, int start, int n, string key) {
+   if (StringLen(key) != n) return false;
+   for (int i = 0; i < n; i++) {
+      if (StringGetCharacter(json, start + i) != StringGetCharacter(key, i)) return false;
+   }
+   return true;
+}
+
+void JsonSkipWhitespace(const string &json, int &pos, int len) {
+   while (pos < len) {
+      ushort ch = StringGetCharacter(json, pos);
+      if (ch != ' ' && ch != '\t' && ch != '\r' && ch != '\n') break;
+      pos++;
+   }
+}
+
+// pos must be on the opening quote. Returns the raw content bounds
+// [start, end) and leaves pos just past the closing quote.
+bool JsonScanString(const string &json, int &pos, int len, int &start, int &end, bool &escaped) {
+   escaped = false;
+   pos++;
+   start = pos;
+   
+   while (pos < len) {
+      ushort ch = StringGetCharacter(json, pos);
+      if (ch == '\\') {
+         escaped = true;
+         pos += 2;
+         continue;
+      }
+      if (ch == '"') {
+         end = pos;
+         pos++;
+         return true;
+      }
+      pos++;
+   }
+   return false;
+}
+
+bool JsonReadString(const string &json, int &pos, int len, string &value) {
+   if (StringGetCharacter(json, pos) != '"') {
+      // Tolerate unquoted scalars (e.g. numeric page_id) by taking them verbatim
+      int start = pos;
+      if (!JsonSkipValue(json, pos, len)) return false;
+      value = StringSubstr(json, start, pos - start);
+      StringTrimRight(value);
+      return true;
+   }
+   
+   int start = 0, end = 0;
+   bool escaped = false;
+   if (!JsonScanString(json, pos, len, start, end, escaped)) return false;
+   
+   value = escaped ? JsonUnescape(json, start, end) : StringSubstr(json, start, end - start);
+   return true;
+}
+
+string JsonUnescape(const string &json, int start, int end) {
+   ushort out[];
+   ArrayResize(out, end - start);
+   int n = 0;
+   
+   for (int i = start; i < end; i++) {
+      ushort ch = StringGetCharacter(json, i);
+      if (ch != '\\' || i + 1 >= end) {
+         out[n++] = ch;
+         continue;
+      }
+      
+      ushort esc = StringGetCharacter(json, ++i);
+      switch (esc) {
+         case 'n': out[n++] = '\n'; break;
+         case 't': out[n++] = '\t'; break;
+         case 'r': out[n++] = '\r'; break;
+         case 'b': out[n++] = 8;    break;
+         case 'f': out[n++] = 12;   break;
+         case 'u': {
+            ushort code = 0;
+            int k = 0;
+            for (; k < 4 && i + 1 < end; k++) {
+               int d = JsonHexDigit(StringGetCharacter(json, i + 1));
+               if (d < 0) break;
+               code = (ushort)(code * 16 + d);
+               i++;
+            }
+            out[n++] = k == 4 ? code : '?';
+            break;
+         }
+         default: out[n++] = esc; break; // \" \\ \/
+      }
+   }
+   
+   return ShortArrayToString(out, 0, n);
+}
+
+int JsonHexDigit(ushort ch) {
+   if (ch >= '0' && ch <= '9') return ch - '0';
+   if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+   if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+   return -1;
+}
+
+// Parse a number in place, including fraction and exponent parts. Quoted
+// numbers ("3320.50") are accepted since some producers send prices as strings.
+bool JsonReadNumber(const string &json, int &pos, int len, double &value) {
+   if (StringGetCharacter(json, pos) == 'n') {
+      value = 0; // null leaves the level unset
+      return JsonSkipValue(json, pos, len);
+   }
+   
+   bool quoted = StringGetCharacter(json, pos) == '"';
+   if (quoted) pos++;
+   
+   bool negative = false;
+   ushort ch = pos < len ? StringGetCharacter(json, pos) : 0;
+   if (ch == '-' || ch == '+') {
+      negative = ch == '-';
+      pos++;
+   }
+   
+   double mantissa = 0;
+   int scale = 0;
+   bool anyDigits = false;
+   
+   while (pos < len && (ch = StringGetCharacter(json, pos)) >= '0' && ch <= '9') {
+      mantissa = mantissa * 10 + (ch - '0');
+      anyDigits = true;
+      pos++;
+   }
+   
+   if (pos < len && StringGetCharacter(json, pos) == '.') {
+      pos++;
+      while (pos < len && (ch = StringGetCharacter(json, pos)) >= '0' && ch <= '9') {
+         mantissa = mantissa * 10 + (ch - '0');
+         scale--;
+         anyDigits = true;
+         pos++;
+      }
+   }
+   
+   if (!anyDigits) return false;
+   
+   if (pos < len && ((ch = StringGetCharacter(json, pos)) == 'e' || ch == 'E')) {
+      pos++;
+      bool expNegative = false;
+      ch = pos < len ? StringGetCharacter(json, pos) : 0;
+      if (ch == '-' || ch == '+') {
+         expNegative = ch == '-';
+         pos++;
+      }
+      int exponent = 0;
+      bool anyExpDigits = false;
+      while (pos < len && (ch = StringGetCharacter(json, pos)) >= '0' && ch <= '9') {
+         exponent = exponent * 10 + (ch - '0');
+         anyExpDigits = true;
+         pos++;
+      }
+      if (!anyExpDigits) return false;
+      scale += expNegative ? -exponent : exponent;
+   }
+   
+   // Divide by an exact power of ten so "3320.55" rounds the same as StringToDouble
+   if (scale < 0) {
+      value = mantissa / MathPow(10, -scale);
+   } else if (scale > 0) {
+      value = mantissa * MathPow(10, scale);
+   } else {
+      value = mantissa;
+   }
+   if (negative) value = -value;
+   
+   if (quoted) {
+      if (pos >= len || StringGetCharacter(json, pos) != '"') return false;
+      pos++;
+   }
+   return true;
+}
+
+// Skip any JSON value (string, number, literal, nested object or array)
+bool JsonSkipValue(const string &json, int &pos, int len) {
+   int depth = 0;
+   
+   while (pos < len) {
+      ushort ch = StringGetCharacter(json, pos);
+      
+      if (ch == '"') {
+         int start = 0, end = 0;
+         bool escaped = false;
+         if (!JsonScanString(json, pos, len, start, end, escaped)) return false;
+         if (depth == 0) return true;
+         continue;
+      }
+      
+      if (ch == '{' || ch == '[') {
+         depth++;
+      } else if (ch == '}' || ch == ']') {
+         if (depth == 0) return true; // End of the enclosing container
+         depth--;
+         if (depth == 0) {
+            pos++;
+            return true;
+         }
+      } else if (ch == ',' && depth == 0) {
+         return true;
+      }
+      pos++;
+   }
    
-   // Extract metadata
+   return depth == 0;
+}
+
+// Legacy per-key extraction, kept only as the baseline for BenchmarkSignalParser()
+bool ParseSignalWithExtractHelpers(string jsonData, SignalParams &signal) {
+   signal.signal = ExtractJSONString(jsonData, "signal");
+   signal.entry = ExtractJSONDouble(jsonData, "entry");
+   signal.sl = ExtractJSONDouble(jsonData, "sl");
+   signal.tp1 = ExtractJSONDouble(jsonData, "tp1");
+   signal.tp2 = ExtractJSONDouble(jsonData, "tp2");
    signal.timestamp = ExtractJSONString(jsonData, "timestamp");
    signal.id = ExtractJSONString(jsonData, "page_id");
+   return signal.signal != "";
+}
+
+// NEW: Helper function to extract string from JSON
+string ExtractJSONString(string json, string key) {
+   string searchPattern = "\"" + key + "\"";
+   int startPos = StringFind(json, searchPattern);
+   if (startPos == -1) return "";
+   
+   startPos = StringFind(json, ":", startPos);
+   if (startPos == -1) return "";
+   
+   startPos = StringFind(json, "\"", startPos);
+   if (startPos == -1) return "";
+   startPos++; // Move past opening quote
+   
+   int endPos = StringFind(json, "\"", startPos);
+   if (endPos == -1) return "";
+   
+   return StringSubstr(json, startPos, endPos - startPos);
+}
+
+// NEW: Helper function to extract double from JSON
+double ExtractJSONDouble(string json, string key) {
+   string searchPattern = "\"" + key + "\"";
+   int startPos = StringFind(json, searchPattern);
+   if (startPos == -1) return 0;
+   
+   startPos = StringFind(json, ":", startPos);
+   if (startPos == -1) return 0;
+   
+   // Skip whitespace and quotes
+   startPos++;
+   while (startPos < StringLen(json) && (StringGetCharacter(json, startPos) == ' ' || 
+          StringGetCharacter(json, startPos) == '"')) {
+      startPos++;
+   }
+   
+   // Find end of number
+   int endPos = startPos;
+   while (endPos < StringLen(json)) {
+      ushort ch = StringGetCharacter(json, endPos);
+      if (ch != '.' && ch != '-' && (ch < '0' || ch > '9')) {
+         break;
+      }
+      endPos++;
+   }
+   
+   if (endPos > startPos) {
+      string numberStr = StringSubstr(json, startPos, endPos - startPos);
+      return StringToDouble(numberStr);
+   }
+   
+   return 0;
+}
+
+
+// Acquire a free slot for a compiled signal and add it to the live lists
+int AcquireSlot(SignalRecord &sig) {
+   if (liveSlotCount >= MathMin(MaxConcurrentSignals, MAX_SIGNAL_SLOTS)) return -1;
+   
+   for (int i = 0; i < MAX_SIGNAL_SLOTS; i++) {
+      if (!slots[i].inUse) {
+         slots[i].index = i;
+         slots[i].inUse = true;
+         slots[i].ordersPlaced = false;
+         slots[i].tradesOpened = false;
+         slots[i].legCount = 0;
+         slots[i].stepCount = 0;
+         slots[i].actionCount = 0;
+         slots[i].nextAction = 0;
+         slots[i].nextTrigger = DBL_MAX;
+         slots[i].journalDirty = false;
+         slots[i].pendingAcks = 0;
+         slots[i].placementFailed = false;
+         slots[i].sig = sig;
+         slots[i].sym = sig.sym;
+         slots[i].direction = sig.direction;
+         ZeroMemory(slots[i].trace);
+         liveSlots[liveSlotCount++] = i;
+         if (sig.direction == SIGNAL_DIR_BUY) liveBuySlots[liveBuyCount++] = i;
+         else liveSellSlots[liveSellCount++] = i;
+         return i;
+      }
+   }
+   return -1;
+}
+
+// Return a slot to the pool (swap-remove from the live list)
+void ReleaseSlot(int index) {
+   JournalRelease(SignalIdOf(slots[index].sig.id));
+   for (int i = 0; i < slots[index].legCount; i++) {
+      TicketIndexRemove(slots[index].legs[i].ticket);
+   }
+   
+   slots[index].inUse = false;
+   slots[index].ordersPlaced = false;
+   slots[index].tradesOpened = false;
+   
+   for (int i = 0; i < liveSlotCount; i++) {
+      if (liveSlots[i] == index) {
+         liveSlots[i] = liveSlots[--liveSlotCount];
+         break;
+      }
+   }
+   for (int i = 0; i < liveBuyCount; i++) {
+      if (liveBuySlots[i] == index) {
+         liveBuySlots[i] = liveBuySlots[--liveBuyCount];
+         break;
+      }
+   }
+   for (int i = 0; i < liveSellCount; i++) {
+      if (liveSellSlots[i] == index) {
+         liveSellSlots[i] = liveSellSlots[--liveSellCount];
+         break;
+      }
+   }
+}
+
+int FindSlotBySignalId(string id) {
+   int ref = FindInternedId(id);
+   if (ref < 0) return -1;
+   for (int i = 0; i < liveSlotCount; i++) {
+      if (slots[liveSlots[i]].sig.id == ref) return liveSlots[i];
+   }
+   return -1;
+}
+
+bool HasFreeSlot() {
+   return liveSlotCount < MathMin(MaxConcurrentSignals, MAX_SIGNAL_SLOTS);
+}
+
+// Trailing is the only per-tick work; fills and closes arrive through
+// OnTradeTransaction and the periodic ReconcileSlots() sweep. The loop is
+// compiled once per direction over the per-direction live lists: BUY slots
+// trail on the bid, SELL slots on the negated ask (triggers are signed), so
+// neither path looks at the direction at all.
+void ManageBuySlots(int sym, double bid) {
+   for (int i = 0; i < liveBuyCount; i++) {
+      int k = liveBuySlots[i];
+      if (slots[k].sym == sym && bid >= slots[k].nextTrigger) FireTrailActions(slots[k], bid);
+   }
+}
+
+void ManageSellSlots(int sym, double ask) {
+   double signedPrice = -ask;
+   for (int i = 0; i < liveSellCount; i++) {
+      int k = liveSellSlots[i];
+      if (slots[k].sym == sym && signedPrice >= slots[k].nextTrigger) FireTrailActions(slots[k], signedPrice);
+   }
+}
+
+// Recently seen signal ids: open-addressed table of 64-bit id hashes plus a
+// FIFO ring that evicts the oldest id once DEDUP_CAPACITY are remembered.
+// Memory is fixed and both lookup and insert are O(1). An entry older than
+// SignalDedupTtlSeconds no longer counts as a duplicate.
+ulong SignalIdHash(string id) {
+   ulong hash = 14695981039346656037;
+   int n = StringLen(id);
+   for (int i = 0; i < n; i++) {
+      hash = (hash ^ StringGetCharacter(id, i)) * 1099511628211;
+   }
+   return hash != 0 ? hash : 1; // 0 marks an empty bucket
+}
+
+int DedupHome(ulong key) {
+   return (int)((key * 0x9E3779B97F4A7C15) >> (64 - DEDUP_BITS));
+}
+
+int DedupFind(ulong key) {
+   int mask = DEDUP_SIZE - 1;
+   for (int i = DedupHome(key); dedupKeys[i] != 0; i = (i + 1) & mask) {
+      if (dedupKeys[i] == key) return i;
+   }
+   return -1;
+}
+
+// Counts a hit or a miss
+bool DedupSeen(string id) {
+   int i = DedupFind(SignalIdHash(id));
+   if (i >= 0 && GetTickCount64() - dedupSeenMs[i] < (ulong)MathMax(SignalDedupTtlSeconds, 1) * 1000) {
+      dedupHits++;
+      return true;
+   }
+   if (i >= 0) dedupExpired++;
+   dedupMisses++;
+   return false;
+}
+
+void DedupRemember(string id) {
+   ulong key = SignalIdHash(id);
+   ulong now = GetTickCount64();
+   
+   // Evict the oldest ring entry unless its id has been remembered again since
+   ulong oldKey = dedupOrder[dedupNext];
+   if (oldKey != 0) {
+      int old = DedupFind(oldKey);
+      if (old >= 0 && dedupSeenMs[old] == dedupOrderMs[dedupNext]) DedupRemoveAt(old);
+   }
+   dedupOrder[dedupNext] = key;
+   dedupOrderMs[dedupNext] = now;
+   dedupNext = (dedupNext + 1) % DEDUP_CAPACITY;
+   
+   int i = DedupFind(key);
+   if (i < 0) {
+      int mask = DEDUP_SIZE - 1;
+      for (i = DedupHome(key); dedupKeys[i] != 0; i = (i + 1) & mask);
+      dedupKeys[i] = key;
+   }
+   dedupSeenMs[i] = now;
+}
+
+// Backward-shift deletion, as in TicketIndexRemove
+void DedupRemoveAt(int i) {
+   int mask = DEDUP_SIZE - 1;
+   int j = i;
+   while (true) {
+      j = (j + 1) & mask;
+      if (dedupKeys[j] == 0) break;
+      int home = DedupHome(dedupKeys[j]);
+      bool stays = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+      if (!stays) {
+         dedupKeys[i] = dedupKeys[j];
+         dedupSeenMs[i] = dedupSeenMs[j];
+         i = j;
+      }
+   }
+   dedupKeys[i] = 0;
+}
+
+// Stable id for signals without page_id: same content and timestamp, same id
+string SignalContentId(SignalParams &signal, int digits) {
+   string content = signal.symbol + "|" + signal.signal + "|" + DoubleToString(signal.entry, digits) +
+                    "|" + DoubleToString(signal.sl, digits) + "|" + DoubleToString(signal.tp1, digits) +
+                    "|" + DoubleToString(signal.tp2, digits) +
+                    "|" + signal.timestamp;
+   return "H" + StringFormat("%016I64x", SignalIdHash(content));
+}
+
+// Interned signal ids. A record holds an index into this pool, so ids are
+// compared as integers and only turned back into text for logs, status events
+// and the journal. Entries are recycled oldest first, skipping any still held
+// by a slot or a queued signal.
+int FindInternedId(string id) {
+   ulong key = SignalIdHash(id);
+   for (int i = 0; i < INTERN_SIZE; i++) {
+      if (internKeys[i] == key && internIds[i] == id) return i;
+   }
+   return -1;
+}
+
+bool InternedIdInUse(int ref) {
+   for (int i = 0; i < liveSlotCount; i++) {
+      if (slots[liveSlots[i]].sig.id == ref) return true;
+   }
+   for (int i = 0; i < intakeCount; i++) {
+      if (intakeQueue[i].sig.id == ref) return true;
+   }
+   return false;
+}
+
+int InternSignalId(string id) {
+   int ref = FindInternedId(id);
+   if (ref >= 0) return ref;
+   
+   while (internKeys[internNext] != 0 && InternedIdInUse(internNext)) {
+      internNext = (internNext + 1) % INTERN_SIZE;
+   }
+   ref = internNext;
+   internKeys[ref] = SignalIdHash(id);
+   internIds[ref] = id;
+   internNext = (internNext + 1) % INTERN_SIZE;
+   return ref;
+}
+
+string SignalIdOf(int ref) {
+   return ref >= 0 && ref < INTERN_SIZE ? internIds[ref] : "";
+}
+
+string DirectionName(ENUM_SIGNAL_DIRECTION direction) {
+   return direction == SIGNAL_DIR_BUY ? "BUY" : "SELL";
+}
+
+// Fixed-point prices: integer points of the symbol
+long PriceToPoints(int sym, double price) {
+   return (long)MathRound(price / symbolSpecs[sym].point);
+}
+
+double PointsToPrice(int sym, long points) {
+   return NormalizeDouble(points * symbolSpecs[sym].point, symbolSpecs[sym].digits);
+}
+
+// The one place direction strings are looked at: turn a parsed signal into
+// the record every later stage works on
+bool CompileSignal(SignalParams &in, SignalRecord &out) {
+   if (in.signal == "BUY") out.direction = SIGNAL_DIR_BUY;
+   else if (in.signal == "SELL") out.direction = SIGNAL_DIR_SELL;
+   else {
+      LogWarn("Invalid signal type: " + in.signal);
+      return false;
+   }
+   
+   out.sym = FindSymbolSpec(in.symbol);
+   if (out.sym < 0) {
+      LogWarn("Symbol " + in.symbol + " is not in TradeSymbols");
+      return false;
+   }
+   
+   out.entry = PriceToPoints(out.sym, in.entry);
+   out.sl = PriceToPoints(out.sym, in.sl);
+   out.tp1 = PriceToPoints(out.sym, in.tp1);
+   out.tp2 = PriceToPoints(out.sym, in.tp2);
+   out.id = InternSignalId(in.id);
+   out.seq = in.seq;
+   out.postedMs = ParseSignalTimeMs(in.timestamp);
+   out.journalSeq = in.journalSeq;
+   out.validated = false;
+   return true;
+}
+
+// Ticket -> leg index: open addressing with linear probing and backward-shift
+// deletion, so lookups from trade transactions never scan the slots
+int TicketIndexHome(ulong ticket) {
+   return (int)((ticket * 0x9E3779B97F4A7C15) >> (64 - TICKET_INDEX_BITS));
+}
+
+void TicketIndexPut(ulong ticket, int slotIndex, int leg) {
+   int mask = TICKET_INDEX_SIZE - 1;
+   int i = TicketIndexHome(ticket);
+   while (ticketKeys[i] != 0 && ticketKeys[i] != ticket) i = (i + 1) & mask;
+   ticketKeys[i] = ticket;
+   ticketRefs[i] = slotIndex * MAX_LEGS + leg;
+}
+
+// Returns slot * MAX_LEGS + leg, or -1 if the ticket is not one of our legs
+int TicketIndexFind(ulong ticket) {
+   if (ticket == 0) return -1;
+   int mask = TICKET_INDEX_SIZE - 1;
+   for (int i = TicketIndexHome(ticket); ticketKeys[i] != 0; i = (i + 1) & mask) {
+      if (ticketKeys[i] == ticket) return ticketRefs[i];
+   }
+   return -1;
+}
+
+void TicketIndexRemove(ulong ticket) {
+   if (ticket == 0) return;
+   int mask = TICKET_INDEX_SIZE - 1;
+   int i = TicketIndexHome(ticket);
+   while (ticketKeys[i] != ticket) {
+      if (ticketKeys[i] == 0) return;
+      i = (i + 1) & mask;
+   }
+   
+   // Pull later entries of the probe run back into the hole
+   int j = i;
+   while (true) {
+      j = (j + 1) & mask;
+      if (ticketKeys[j] == 0) break;
+      int home = TicketIndexHome(ticketKeys[j]);
+      bool stays = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+      if (!stays) {
+         ticketKeys[i] = ticketKeys[j];
+         ticketRefs[i] = ticketRefs[j];
+         i = j;
+      }
+   }
+   ticketKeys[i] = 0;
+}
+
+// Leg state transitions shared by the transaction handler and the sweep
+void MarkLegFilled(int slotIndex, int leg, double price) {
+   if ((slots[slotIndex].legs[leg].flags & (LEG_ACTIVE | LEG_POSITION)) != LEG_ACTIVE) return;
+   
+   slots[slotIndex].legs[leg].flags |= LEG_POSITION;
+   slots[slotIndex].legs[leg].fillUs = GetMicrosecondCount();
+   RecordFillLatency(slots[slotIndex], leg);
+   QueueStatusEvent(STATUS_FILLED, slots[slotIndex], leg, price, slots[slotIndex].legs[leg].sl);
+   CompileTrailActions(slots[slotIndex]);
+   JournalSlot(slots[slotIndex]);
+   LogFmt(LOG_LEVEL_INFO, "[%s] Leg %i filled and converted to position: %i", leg + 1,
+          (long)slots[slotIndex].legs[leg].ticket, 0, SignalIdOf(slots[slotIndex].sig.id));
+   if (!slots[slotIndex].tradesOpened) {
+      LogMessage("[" + SignalIdOf(slots[slotIndex].sig.id) + "] At least one order filled. Trailing stops now active.");
+   }
+   RefreshSlotState(slotIndex);
+}
+
+void MarkLegClosed(int slotIndex, int leg, string reason, double price = 0) {
+   if ((slots[slotIndex].legs[leg].flags & LEG_ACTIVE) == 0) return;
+   
+   bool wasPosition = (slots[slotIndex].legs[leg].flags & LEG_POSITION) != 0;
+   QueueStatusEvent(wasPosition ? STATUS_CLOSED : STATUS_CANCELLED, slots[slotIndex], leg, price, slots[slotIndex].legs[leg].sl);
+   slots[slotIndex].legs[leg].flags &= (uchar)~LEG_ACTIVE;
+   TicketIndexRemove(slots[slotIndex].legs[leg].ticket);
+   JournalSlot(slots[slotIndex]);
+   LogFmt(LOG_LEVEL_INFO, "[%s] Leg %i %s: %i", leg + 1, (long)slots[slotIndex].legs[leg].ticket, 0,
+          SignalIdOf(slots[slotIndex].sig.id), reason);
+   RefreshSlotState(slotIndex);
+}
+
+// Recompute the slot summary flags and release the slot once every leg is done
+void RefreshSlotState(int slotIndex) {
+   bool anyPending = false;
+   bool anyOpen = false;
+   
+   for (int i = 0; i < slots[slotIndex].legCount; i++) {
+      uchar flags = slots[slotIndex].legs[i].flags;
+      if ((flags & LEG_ACTIVE) == 0) continue;
+      if ((flags & LEG_POSITION) != 0) anyOpen = true;
+      else anyPending = true;
+   }
+   
+   if (slots[slotIndex].ordersPlaced && !anyPending) {
+      LogMessage("[" + SignalIdOf(slots[slotIndex].sig.id) + "] All pending orders processed.");
+   }
+   
+   slots[slotIndex].ordersPlaced = anyPending;
+   slots[slotIndex].tradesOpened = anyOpen;
+   
+   // A slot still waiting on async placement replies is finished by FinishAsyncPlacement
+   if (!anyPending && !anyOpen && slots[slotIndex].pendingAcks == 0) {
+      LogMessage("[" + SignalIdOf(slots[slotIndex].sig.id) + "] All positions closed. Slot released.");
+      ReleaseSlot(slotIndex);
+   }
+}
+
+// Safety net for missed transactions (terminal reconnects, manual edits):
+// probe every live leg against the terminal at ReconcileIntervalSeconds
+void ReconcileSlots() {
+   for (int i = liveSlotCount - 1; i >= 0; i--) {
+      int slotIndex = liveSlots[i];
+      
+      for (int leg = 0; leg < slots[slotIndex].legCount && slots[slotIndex].inUse; leg++) {
+         uchar flags = slots[slotIndex].legs[leg].flags;
+         ulong ticket = slots[slotIndex].legs[leg].ticket;
+         if ((flags & LEG_ACTIVE) == 0) continue;
+         
+         if ((flags & LEG_POSITION) != 0) {
+            if (!PositionSelectByTicket(ticket)) MarkLegClosed(slotIndex, leg, "closed (reconciled)");
+         } else if (!OrderSelect(ticket)) {
+            // Order no longer exists, check if it became a position
+            if (PositionSelectByTicket(ticket)) MarkLegFilled(slotIndex, leg, PositionGetDouble(POSITION_PRICE_OPEN));
+            else MarkLegClosed(slotIndex, leg, "expired or cancelled (reconciled)");
+         }
+      }
+   }
+}
+
+// Route placement replies, fills, cancels, expiries and closes of our legs
+// into the leg table
+void ApplyTradeTransaction(const MqlTradeTransaction &trans, const MqlTradeResult &result) {
+   if (trans.type == TRADE_TRANSACTION_REQUEST) {
+      if (asyncPlacementsInFlight > 0) OnPlacementAck(result);
+      if (orphanAckCount > 0) OnOrphanAck(result);
+   } else if (trans.type == TRADE_TRANSACTION_DEAL_ADD) {
+      if (!HistoryDealSelect(trans.deal)) return;
+      ENUM_DEAL_ENTRY entry = (ENUM_DEAL_ENTRY)HistoryDealGetInteger(trans.deal, DEAL_ENTRY);
+      
+      if (entry == DEAL_ENTRY_IN) {
+         int ref = TicketIndexFind(trans.order);
+         if (ref >= 0) MarkLegFilled(ref / MAX_LEGS, ref % MAX_LEGS, trans.price);
+         else if (asyncPlacementsInFlight > 0 && HistoryDealGetInteger(trans.deal, DEAL_MAGIC) == MagicNumber) {
+            // The fill can overtake the placement reply; OnPlacementAck applies it
+            earlyFillOrders[earlyFillNext] = trans.order;
+            earlyFillPrices[earlyFillNext] = trans.price;
+            earlyFillNext = (earlyFillNext + 1) % EARLY_FILL_SIZE;
+         }
+      } else if (entry == DEAL_ENTRY_OUT || entry == DEAL_ENTRY_OUT_BY) {
+         int ref = TicketIndexFind(trans.position);
+         // Partial closes leave the position open
+         if (ref >= 0 && !PositionSelectByTicket(trans.position)) {
+            MarkLegClosed(ref / MAX_LEGS, ref % MAX_LEGS, "closed", trans.price);
+         }
+      }
+   } else if (trans.type == TRADE_TRANSACTION_HISTORY_ADD) {
+      if (trans.order_state != ORDER_STATE_CANCELED && trans.order_state != ORDER_STATE_EXPIRED &&
+          trans.order_state != ORDER_STATE_REJECTED) return;
+      
+      int ref = TicketIndexFind(trans.order);
+      if (ref >= 0 && (slots[ref / MAX_LEGS].legs[ref % MAX_LEGS].flags & LEG_POSITION) == 0) {
+         MarkLegClosed(ref / MAX_LEGS, ref % MAX_LEGS, "expired or cancelled");
+      }
+   }
+}
+
+// Fire every compiled trail action whose trigger the price has reached.
+// Actions are sorted by signed trigger, so the caller only compares the
+// price against nextTrigger and this runs only when something is due.
+void FireTrailActions(SignalSlot &slot, double signedPrice) {
+   int first = slot.nextAction;
+   
+   while (slot.nextAction < slot.actionCount && slot.actions[slot.nextAction].trigger <= signedPrice) {
+      int leg = slot.actions[slot.nextAction].leg;
+      int step = slot.actions[slot.nextAction].step;
+      
+      // Legs closed since compilation are simply skipped
+      if ((slot.legs[leg].flags & (LEG_ACTIVE | LEG_POSITION)) == (LEG_ACTIVE | LEG_POSITION)) {
+         if (!UpdateSL(slot.legs[leg], slot.sym, slot.direction, slot.stepSL[step])) break; // Retry on a later tick
+         
+         LogFmt(LOG_LEVEL_INFO, "%s: Moved SL to %p for leg %i (ticket: %i)", leg + 1, (long)slot.legs[leg].ticket,
+                slot.stepSL[step], DirectionName(slot.direction), "", symbolSpecs[slot.sym].digits);
+         QueueStatusEvent(STATUS_SL_MOVED, slot, leg, MathAbs(signedPrice), slot.legs[leg].sl);
+      }
+      slot.legs[leg].trailDone |= (uint)1 << step;
+      slot.nextAction++;
+   }
+   
+   slot.nextTrigger = slot.nextAction < slot.actionCount ? slot.actions[slot.nextAction].trigger : DBL_MAX;
+   // The journal write is a file write and flush; keep it off the tick path
+   if (slot.nextAction != first) slot.journalDirty = true;
+}
+
+// Rebuild the sorted action list from the legs that are live positions.
+// Called once per signal after placement and again whenever a leg fills;
+// both are rare compared to ticks.
+void CompileTrailActions(SignalSlot &slot) {
+   slot.actionCount = 0;
+   slot.nextAction = 0;
+   
+   for (int i = 0; i < slot.legCount; i++) {
+      if ((slot.legs[i].flags & (LEG_ACTIVE | LEG_POSITION)) != (LEG_ACTIVE | LEG_POSITION)) continue;
+      
+      uint pending = slot.legs[i].trailMask & ~slot.legs[i].trailDone;
+      for (int j = 0; j < slot.stepCount; j++) {
+         if ((pending & ((uint)1 << j)) == 0) continue;
+         
+         // Insertion sort by signed trigger; ties keep leg order
+         double trigger = slot.direction * slot.stepTrigger[j];
+         int k = slot.actionCount++;
+         while (k > 0 && slot.actions[k - 1].trigger > trigger) {
+            slot.actions[k] = slot.actions[k - 1];
+            k--;
+         }
+         slot.actions[k].trigger = trigger;
+         slot.actions[k].leg = (uchar)i;
+         slot.actions[k].step = (uchar)j;
+      }
+   }
+   
+   slot.nextTrigger = slot.actionCount > 0 ? slot.actions[0].trigger : DBL_MAX;
+}
+
+// Move a leg's SL using the SL and TP we already track, so the tick path
+// never has to select the position first. Trail steps only ever tighten.
+bool UpdateSL(LegState &leg, int sym, ENUM_SIGNAL_DIRECTION direction, double new_sl) {
+   new_sl = NormalizeDouble(new_sl, symbolSpecs[sym].digits);
+   
+   // Avoid unnecessary modifications, never move SL backwards
+   if ((new_sl - leg.sl) * direction < symbolSpecs[sym].point) {
+      return true;
+   }
+   
+   bool result = BrokerModifySL(leg.ticket, new_sl, leg.tp);
+   if (result) {
+      leg.sl = new_sl;
+   } else {
+      LogFmt(LOG_LEVEL_ERROR, "Error modifying position %i: %i - %s", (long)leg.ticket, trade.ResultRetcode(), 0,
+             trade.ResultRetcodeDescription());
+   }
+   return result;
+}
+
+bool OpenSignalTrades(SignalSlot &slot) {
+   // Signals from the feed were validated on intake; only simulated and
+   // replayed ones still need it
+   if (!slot.sig.validated && !ValidateSignalParams(slot.sig)) {
+      LogWarn("Error: Invalid signal parameters");
+      return false;
+   }
+   
+   trade.SetExpertMagicNumber(MagicNumber);
+   trade.SetDeviationInPoints(SlippagePoints);
+   
+   BuildLegTable(slot);
+   
+   // Every leg gets the same volume, so one under the minimum skips them all
+   if (slot.legs[0].lots <= 0) {
+      LogWarn("[" + SignalIdOf(slot.sig.id) + "] Skipping legs: " + DoubleToString(AccountLots(), 4) + " lots for this account is below the " +
+              symbolSpecs[slot.sym].name + " minimum of " + DoubleToString(symbolSpecs[slot.sym].volumeMin, 2));
+      return false;
+   }
+   
+   // Calculate expiration time
+   datetime expiration = TimeCurrent() + OrderExpirationHours * 3600;
+   
+   LogFmt(LOG_LEVEL_INFO, (UseLimitOrders ? "Placing %s %s LIMIT orders at %p" : "Placing %s %s MARKET orders at %p") +
+          (UseAsyncPlacement ? " (async)" : ""), 0, 0, PointsToPrice(slot.sym, slot.sig.entry), symbolSpecs[slot.sym].name,
+          DirectionName(slot.direction), symbolSpecs[slot.sym].digits);
+   
+   if (UseAsyncPlacement && !replayActive) {
+      // Completion is reported from OnTradeTransaction once every leg is acknowledged
+      return SendLegsAsync(slot, expiration);
+   }
+   
+   bool success = PlaceLegs(slot, expiration);
+   
+   if (success) {
+      OnSlotPlaced(slot);
+   }
+   
+   return success;
+}
+
+// Report what OpenSignalTrades left behind. Async placement has only sent
+// the legs by then; if a send failed part way the slot is rolled back once
+// the legs already sent have answered, so it is not reported as processed.
+void LogPlacementOutcome(SignalSlot &slot) {
+   if (slot.pendingAcks == 0) {
+      LogMessage("Signal processed successfully");
+   } else if (slot.placementFailed) {
+      LogFmt(LOG_LEVEL_WARN, "[%s] Sent %i of %i legs before a send failed; rolling back once they answer", slot.pendingAcks,
+             slot.legCount, 0, SignalIdOf(slot.sig.id));
+   } else {
+      LogFmt(LOG_LEVEL_INFO, "[%s] Signal sent, %i legs awaiting acknowledgement", slot.pendingAcks, 0, 0, SignalIdOf(slot.sig.id));
+   }
+}
+
+// Report a fully placed signal
+void OnSlotPlaced(SignalSlot &slot) {
+   string id = SignalIdOf(slot.sig.id);
+   for (int i = 0; i < slot.legCount; i++) {
+      LogFmt(LOG_LEVEL_INFO, "[%s] Leg %i placed: ticket %i", i + 1, (long)slot.legs[i].ticket, 0, id);
+   }
+   LogFmt(LOG_LEVEL_INFO, "[%s] Placement latency: %i us for %i legs", (long)(GetMicrosecondCount() - slot.placeStartUs), slot.legCount, 0, id);
+
+   RecordPlacementLatency(slot);
+   JournalSlot(slot);
+   
+   if (slot.retries > 0) {
+      retrySignalsRecovered++;
+      retryAddedUsSum += slot.retryUs;
+      LogFmt(LOG_LEVEL_INFO, "[%s] Placed after %i retries, +%i us", slot.retries, (long)slot.retryUs, 0, id);
+   }
+   
+   // Queue the database update (order is processed); OnTimer sends it
+   for (int i = 0; i < slot.legCount; i++) {
+      QueueStatusEvent(STATUS_PLACED, slot, i, PointsToPrice(slot.sym, slot.sig.entry), slot.legs[i].sl);
+   }
+   int last = (statusHead + statusCount - 1) % STATUS_QUEUE_SIZE;
+   if (statusCount > 0) statusQueue[last].trace = FormatSignalTrace(slot);
+}
+
+// Lay out the scale-out ladder for a signal: TP1, TP2, further legs spaced
+// TP2-TP1 apart, and the runner at TP1 + TP3_Offset (the original third
+// leg). The default three legs reproduce the TP1/TP2/TP3 setup exactly.
+void BuildLegTable(SignalSlot &slot) {
+   int n = (int)MathMax(2, MathMin(LadderLegs, MAX_LEGS));
+   double dir = slot.direction;
+   double entry = PointsToPrice(slot.sym, slot.sig.entry);
+   double tp1 = PointsToPrice(slot.sym, slot.sig.tp1);
+   double tp2 = PointsToPrice(slot.sym, slot.sig.tp2);
+   double spacing = tp2 - tp1;
+   
+   // Ladder step j fires at the j-th ladder target and locks in the level below it
+   int ladderSteps = n - 1;
+   for (int j = 0; j < ladderSteps; j++) {
+      slot.stepTrigger[j] = j == 0 ? tp1 : tp2 + (j - 1) * spacing;
+      slot.stepSL[j] = j == 0 ? entry : slot.stepTrigger[j - 1];
+   }
+   slot.stepCount = ladderSteps;
+   
+   // Optional extra steps past the last ladder target, fixed or ATR-sized
+   double point = symbolSpecs[slot.sym].point;
+   double stepSize = TrailStepPoints * point;
+   double distance = TrailDistancePoints * point;
+   if (TrailATRPeriod > 0) {
+      double atr = CurrentATR(slot.sym);
+      if (atr > 0) {
+         stepSize = atr * TrailATRMultiplier;
+         distance = atr * TrailATRMultiplier;
+      }
+   }
+   if (stepSize > 0 && distance > 0) {
+      double base = slot.stepTrigger[ladderSteps - 1];
+      for (int k = 1; k <= TrailExtraSteps && slot.stepCount < MAX_TRAIL_STEPS; k++) {
+         slot.stepTrigger[slot.stepCount] = base + dir * k * stepSize;
+         slot.stepSL[slot.stepCount] = NormalizePrice(slot.sym, slot.stepTrigger[slot.stepCount] - dir * distance);
+         slot.stepCount++;
+      }
+   }
+   
+   slot.legCount = n;
+   for (int i = 0; i < n; i++) {
+      double tp;
+      if (i == 0) {
+         tp = tp1;
+      } else if (i == n - 1 && n >= 3) {
+         tp = tp1 + dir * TP3_Offset * point;
+      } else {
+         tp = tp2 + (i - 1) * spacing;
+      }
+      
+      // Leg i follows the ladder steps below it, plus any extra step that
+      // fires before its TP, but never trails its SL up to its own TP
+      uint mask = 0;
+      for (int j = 0; j < slot.stepCount; j++) {
+         if ((slot.stepSL[j] - tp) * dir >= 0) break;
+         if (j < ladderSteps ? j < i : (slot.stepTrigger[j] - tp) * dir < 0) mask |= (uint)1 << j;
+      }
+      
+      slot.legs[i].ticket = 0;
+      slot.legs[i].tp = NormalizePrice(slot.sym, tp);
+      slot.legs[i].sl = PointsToPrice(slot.sym, slot.sig.sl);
+      slot.legs[i].lots = NormalizeVolume(slot.sym, AccountLots());
+      slot.legs[i].flags = 0;
+      slot.legs[i].trailMask = mask;
+      slot.legs[i].trailDone = 0;
+      slot.legs[i].ackUs = 0;
+      slot.legs[i].fillUs = 0;
+   }
+   
+   slot.actionCount = 0;
+   slot.nextAction = 0;
+   slot.nextTrigger = DBL_MAX;
+}
+
+double CurrentATR(int sym) {
+   if (symbolSpecs[sym].atrHandle == INVALID_HANDLE) return 0;
+   double buffer[1];
+   if (CopyBuffer(symbolSpecs[sym].atrHandle, 0, 1, 1, buffer) != 1) return 0;
+   return buffer[0];
+}
+
+// Placement retries. Requotes, price changes, off quotes and other transient
+// retcodes are resent at a fresh price while the signal is still inside its
+// budget: RetryBudgetMs from the first send, MaxRetriesPerLeg attempts, and
+// at most RetrySlippagePoints adverse to the entry for market orders. Other
+// retcodes, or a spent budget, fall through to the usual rollback.
+bool IsTransientRetcode(uint retcode) {
+   switch (retcode) {
+      case TRADE_RETCODE_REQUOTE:
+      case TRADE_RETCODE_PRICE_CHANGED:
+      case TRADE_RETCODE_PRICE_OFF:
+      case TRADE_RETCODE_TIMEOUT:
+      case TRADE_RETCODE_CONNECTION:
+      case TRADE_RETCODE_TOO_MANY_REQUESTS:
+      case TRADE_RETCODE_LOCKED:
+         return true;
+   }
+   return false;
+}
+
+// Price for the next attempt, or 0 when the leg should not be retried
+double NextAttemptPrice(SignalSlot &slot, int leg, uint retcode) {
+   if (!IsTransientRetcode(retcode) || slot.legs[leg].attempts >= MaxRetriesPerLeg) return 0;
+   if (GetMicrosecondCount() - slot.placeStartUs > (ulong)RetryBudgetMs * 1000) return 0;
+   if (UseLimitOrders) return PointsToPrice(slot.sym, slot.sig.entry);
+   
+   // Only a requote or a price change calls for a fresh price; the rest of
+   // the transient retcodes are resent as they were
+   if (retcode != TRADE_RETCODE_REQUOTE && retcode != TRADE_RETCODE_PRICE_CHANGED) return slot.legs[leg].sendPrice;
+   
+   MqlTick tick;
+   if (!SymbolInfoTick(symbolSpecs[slot.sym].name, tick)) return 0;
+   double price = slot.direction == SIGNAL_DIR_BUY ? tick.ask : tick.bid;
+   if ((PriceToPoints(slot.sym, price) - slot.sig.entry) * slot.direction > RetrySlippagePoints) {
+      LogFmt(LOG_LEVEL_WARN, "[%s] Leg %i not retried: price %p is past the slippage budget", leg + 1, 0, price, SignalIdOf(slot.sig.id),
+             "", symbolSpecs[slot.sym].digits);
+      return 0;
+   }
+   return price;
+}
+
+// Connection, rate-limit and busy-server retcodes do not clear by resending
+// at once: wait RetryPauseMs, doubled per retry of the leg and capped at what
+// is left of RetryBudgetMs. Requotes and price changes go out straight away.
+uint RetryPause(SignalSlot &slot, int leg, uint retcode) {
+   if (retcode == TRADE_RETCODE_REQUOTE || retcode == TRADE_RETCODE_PRICE_CHANGED) return 0;
+   
+   ulong spentMs = (GetMicrosecondCount() - slot.placeStartUs) / 1000;
+   if (spentMs >= (ulong)RetryBudgetMs) return 0;
+   ulong pauseMs = (ulong)MathMax(RetryPauseMs, 0) << MathMin(MathMax(slot.legs[leg].attempts - 1, 0), 8);
+   return (uint)MathMin(pauseMs, (ulong)RetryBudgetMs - spentMs);
+}
+
+// Book a retry; the failed attempt's time counts as added latency
+void RecordRetry(SignalSlot &slot, int leg, uint retcode) {
+   ulong now = GetMicrosecondCount();
+   slot.retryUs += now - slot.legs[leg].sentUs;
+   slot.retries++;
+   slot.legs[leg].attempts++;
+   slot.legs[leg].sentUs = now;
+   retryAttempts++;
+   LogFmt(LOG_LEVEL_WARN, "[%s] Leg %i retcode %i, retrying", leg + 1, retcode, 0, SignalIdOf(slot.sig.id));
+}
+
+// Broker calls made by the slot state machine. In replay mode they act on the
+// paper book instead of the terminal; see RunReplay().
+ulong BrokerPlaceLeg(SignalSlot &slot, int i, ENUM_ORDER_TYPE type, double price, datetime expiration, string comment) {
+   if (replayActive) {
+      int ref = slot.index * MAX_LEGS + i;
+      bool market = type == ORDER_TYPE_BUY || type == ORDER_TYPE_SELL;
+      paperBook[ref].ticket = replayNextTicket++;
+      paperBook[ref].dir = slot.direction;
+      paperBook[ref].price = market ? (slot.direction > 0 ? replayTick.ask : replayTick.bid) : price;
+      paperBook[ref].sl = slot.legs[i].sl;
+      paperBook[ref].tp = slot.legs[i].tp;
+      paperBook[ref].lots = slot.legs[i].lots;
+      paperBook[ref].contractSize = symbolSpecs[slot.sym].contractSize;
+      paperBook[ref].expiryMs = replayTick.time_msc + (long)OrderExpirationHours * 3600000;
+      paperBook[ref].state = market ? PAPER_POSITION : PAPER_PENDING;
+      if (market) {
+         replayFills++;
+         WriteReplayEvent(ref, "filled", paperBook[ref].price, 0);
+      }
+      return paperBook[ref].ticket;
+   }
+   
+   string symbol = symbolSpecs[slot.sym].name;
+   trade.SetTypeFilling(symbolSpecs[slot.sym].filling);
+   
+   bool sent;
+   if (UseLimitOrders) {
+      sent = trade.OrderOpen(symbol, type, slot.legs[i].lots, 0, price, slot.legs[i].sl, slot.legs[i].tp,
+                             ORDER_TIME_SPECIFIED, expiration, comment);
+   } else {
+      sent = trade.PositionOpen(symbol, type, slot.legs[i].lots, price, slot.legs[i].sl, slot.legs[i].tp, comment);
+   }
+   // OrderOpen/PositionOpen return bool; the ticket comes from the result
+   return sent ? trade.ResultOrder() : 0;
+}
+
+bool BrokerModifySL(ulong ticket, double sl, double tp) {
+   if (replayActive) {
+      int ref = TicketIndexFind(ticket);
+      if (ref < 0 || paperBook[ref].state != PAPER_POSITION) return false;
+      paperBook[ref].sl = sl;
+      replaySlMoves++;
+      WriteReplayEvent(ref, "sl_moved", replayTick.bid, 0);
+      return true;
+   }
+   return trade.PositionModify(ticket, sl, tp);
+}
+
+bool BrokerCancelOrder(ulong ticket) {
+   if (replayActive) {
+      int ref = TicketIndexFind(ticket);
+      if (ref >= 0) paperBook[ref].state = PAPER_NONE;
+      return ref >= 0;
+   }
+   return trade.OrderDelete(ticket);
+}
+
+bool BrokerClosePosition(ulong ticket) {
+   if (replayActive) {
+      int ref = TicketIndexFind(ticket);
+      if (ref < 0 || paperBook[ref].state != PAPER_POSITION) return false;
+      ClosePaperPosition(ref, paperBook[ref].dir > 0 ? replayTick.bid : replayTick.ask);
+      return true;
+   }
+   return trade.PositionClose(ticket);
+}
+
+// Send every leg in order; on any failure roll back the legs already placed
+bool PlaceLegs(SignalSlot &slot, datetime expiration) {
+   bool isBuy = slot.direction == SIGNAL_DIR_BUY;
+   ENUM_ORDER_TYPE type = UseLimitOrders ? (isBuy ? ORDER_TYPE_BUY_LIMIT : ORDER_TYPE_SELL_LIMIT)
+                                         : (isBuy ? ORDER_TYPE_BUY : ORDER_TYPE_SELL);
+   
+   slot.placeStartUs = GetMicrosecondCount();
+   slot.retries = 0;
+   slot.retryUs = 0;
+   
+   for (int i = 0; i < slot.legCount; i++) {
+      string comment = "TP" + IntegerToString(i + 1) + (UseLimitOrders ? " Limit Order" : " Trade");
+      slot.legs[i].sentUs = GetMicrosecondCount();
+      slot.legs[i].attempts = 0;
+      slot.legs[i].sendPrice = PointsToPrice(slot.sym, slot.sig.entry);
+      ulong ticket = BrokerPlaceLeg(slot, i, type, slot.legs[i].sendPrice, expiration, comment);
+      
+      while (ticket == 0) {
+         uint retcode = trade.ResultRetcode();
+         double price = NextAttemptPrice(slot, i, retcode);
+         if (price == 0) break;
+         RecordRetry(slot, i, retcode);
+         uint pauseMs = RetryPause(slot, i, retcode);
+         if (pauseMs > 0) Sleep(pauseMs);
+         slot.legs[i].sendPrice = price;
+         ticket = BrokerPlaceLeg(slot, i, type, price, expiration, comment);
+      }
+      
+      slot.legs[i].ackUs = GetMicrosecondCount();
+      LogFmt(LOG_LEVEL_INFO, "[%s] Leg %i sent in %i us", i + 1, (long)(GetMicrosecondCount() - slot.legs[i].sentUs), 0, SignalIdOf(slot.sig.id));
+      
+      if (ticket == 0) {
+         if (slot.legs[i].attempts > 0) retryExhausted++;
+         LogError("Failed to " + (UseLimitOrders ? "place limit order " : "open position ") +
+                    IntegerToString(i + 1) + ": " + IntegerToString(trade.ResultRetcode()));
+         for (int k = 0; k < i; k++) {
+            if (UseLimitOrders) BrokerCancelOrder(slot.legs[k].ticket);
+            else BrokerClosePosition(slot.legs[k].ticket);
+            TicketIndexRemove(slot.legs[k].ticket);
+            slot.legs[k].flags = 0;
+         }
+         return false;
+      }
+      
+      slot.legs[i].ticket = ticket;
+      TicketIndexPut(ticket, slot.index, i);
+      // Market orders are immediately positions
+      slot.legs[i].flags = UseLimitOrders ? LEG_ACTIVE : (uchar)(LEG_ACTIVE | LEG_POSITION);
+   }
+   
+   if (UseLimitOrders) slot.ordersPlaced = true;
+   else slot.tradesOpened = true;
+   
+   CompileTrailActions(slot);
+   
+   return true;
+}
+
+// Fire all legs at once with OrderSendAsync. Each request id is kept on its
+// leg and matched to the server reply in OnTradeTransaction; the slot stays
+// in placement until every leg has answered or AsyncAckTimeoutMs runs out.
+bool SendLegsAsync(SignalSlot &slot, datetime expiration) {
+   slot.pendingAcks = 0;
+   slot.placementFailed = false;
+   slot.placeStartUs = GetMicrosecondCount();
+   slot.placeDeadlineMs = GetTickCount64() + (ulong)MathMax(AsyncAckTimeoutMs, 100);
+   slot.placeExpiration = expiration;
+   slot.retries = 0;
+   slot.retryUs = 0;
+   
+   for (int i = 0; i < slot.legCount; i++) {
+      slot.legs[i].attempts = 0;
+      slot.legs[i].ackUs = 0;
+      slot.legs[i].retryAtMs = 0;
+      slot.legs[i].sentUs = GetMicrosecondCount();
+      if (!SendLegAsync(slot, i, PointsToPrice(slot.sym, slot.sig.entry))) {
+         slot.placementFailed = true;
+         break;
+      }
+      slot.pendingAcks++;
+   }
+   
+   if (slot.pendingAcks == 0) return false;
+   
+   asyncPlacementsInFlight++;
+   return true;
+}
+
+// Send one leg with OrderSendAsync; also used to resend a leg on retry
+bool SendLegAsync(SignalSlot &slot, int i, double price) {
+   bool isBuy = slot.direction == SIGNAL_DIR_BUY;
+   MqlTradeRequest request;
+   MqlTradeResult result;
+   ZeroMemory(request);
+   ZeroMemory(result);
+   
+   request.action = UseLimitOrders ? TRADE_ACTION_PENDING : TRADE_ACTION_DEAL;
+   request.symbol = symbolSpecs[slot.sym].name;
+   request.magic = MagicNumber;
+   request.volume = slot.legs[i].lots;
+   request.type = UseLimitOrders ? (isBuy ? ORDER_TYPE_BUY_LIMIT : ORDER_TYPE_SELL_LIMIT)
+                                 : (isBuy ? ORDER_TYPE_BUY : ORDER_TYPE_SELL);
+   request.price = price;
+   request.sl = slot.legs[i].sl;
+   request.tp = slot.legs[i].tp;
+   request.deviation = SlippagePoints;
+   request.comment = "TP" + IntegerToString(i + 1) + (UseLimitOrders ? " Limit Order" : " Trade");
+   if (UseLimitOrders) {
+      request.type_filling = ORDER_FILLING_RETURN;
+      request.type_time = ORDER_TIME_SPECIFIED;
+      request.expiration = slot.placeExpiration;
+   } else {
+      request.type_filling = symbolSpecs[slot.sym].filling;
+   }
+   
+   if (!OrderSendAsync(request, result)) {
+      LogError("Failed to send leg " + IntegerToString(i + 1) + " asynchronously: " + IntegerToString(result.retcode));
+      return false;
+   }
+   
+   slot.legs[i].requestId = result.request_id;
+   slot.legs[i].sendPrice = price;
+   return true;
+}
+
+// Filling mode for raw market requests, mirroring CTrade::SetTypeFillingBySymbol
+ENUM_ORDER_TYPE_FILLING SymbolFillingMode(string symbol) {
+   long modes = SymbolInfoInteger(symbol, SYMBOL_FILLING_MODE);
+   if ((modes & SYMBOL_FILLING_FOK) != 0) return ORDER_FILLING_FOK;
+   if ((modes & SYMBOL_FILLING_IOC) != 0) return ORDER_FILLING_IOC;
+   return ORDER_FILLING_RETURN;
+}
+
+// Match a server reply to the leg that sent it
+void OnPlacementAck(const MqlTradeResult &result) {
+   for (int s = 0; s < liveSlotCount; s++) {
+      int slotIndex = liveSlots[s];
+      if (slots[slotIndex].pendingAcks == 0) continue;
+      
+      for (int i = 0; i < slots[slotIndex].legCount; i++) {
+         if (slots[slotIndex].legs[i].requestId != result.request_id || slots[slotIndex].legs[i].ticket != 0) continue;
+         
+         bool ok = (result.retcode == TRADE_RETCODE_DONE || result.retcode == TRADE_RETCODE_PLACED ||
+                    result.retcode == TRADE_RETCODE_DONE_PARTIAL) && result.order != 0;
+         LogFmt(ok ? LOG_LEVEL_INFO : LOG_LEVEL_ERROR, "[%s] Leg %i ack in %i us: " + (ok ? "ticket " : "retcode ") + "%s",
+                i + 1, (long)(GetMicrosecondCount() - slots[slotIndex].legs[i].sentUs), 0, SignalIdOf(slots[slotIndex].sig.id),
+                ok ? IntegerToString(result.order) : IntegerToString(result.retcode));
+         
+         if (ok) {
+            slots[slotIndex].legs[i].ackUs = GetMicrosecondCount();
+            slots[slotIndex].legs[i].ticket = result.order;
+            // Market orders are immediately positions
+            slots[slotIndex].legs[i].flags = UseLimitOrders ? LEG_ACTIVE : (uchar)(LEG_ACTIVE | LEG_POSITION);
+            TicketIndexPut(result.order, slotIndex, i);
+            for (int f = 0; f < EARLY_FILL_SIZE; f++) {
+               if (earlyFillOrders[f] != result.order) continue;
+               earlyFillOrders[f] = 0;
+               MarkLegFilled(slotIndex, i, earlyFillPrices[f]);
+            }
+         } else {
+            // Resend transient failures; the leg keeps its place in pendingAcks
+            double price = NextAttemptPrice(slots[slotIndex], i, result.retcode);
+            if (price != 0) {
+               RecordRetry(slots[slotIndex], i, result.retcode);
+               uint pauseMs = RetryPause(slots[slotIndex], i, result.retcode);
+               if (pauseMs > 0) {
+                  // CheckPlacementTimeouts resends it from OnTimer
+                  slots[slotIndex].legs[i].requestId = 0;
+                  slots[slotIndex].legs[i].sendPrice = price;
+                  slots[slotIndex].legs[i].retryAtMs = GetTickCount64() + pauseMs;
+                  return;
+               }
+               if (SendLegAsync(slots[slotIndex], i, price)) return;
+            }
+            if (slots[slotIndex].legs[i].attempts > 0) retryExhausted++;
+            slots[slotIndex].placementFailed = true;
+         }
+         
+         slots[slotIndex].legs[i].requestId = 0;
+         if (--slots[slotIndex].pendingAcks == 0) FinishAsyncPlacement(slotIndex);
+         return;
+      }
+   }
+}
+
+// Legs that have not answered by the deadline count as failed. Resends held
+// back by RetryPause go out from here once their pause is over.
+void CheckPlacementTimeouts() {
+   if (asyncPlacementsInFlight == 0) return;
+   
+   ulong now = GetTickCount64();
+   for (int s = liveSlotCount - 1; s >= 0; s--) {
+      int slotIndex = liveSlots[s];
+      if (slots[slotIndex].pendingAcks == 0) continue;
+      
+      if (now < slots[slotIndex].placeDeadlineMs) {
+         for (int i = 0; i < slots[slotIndex].legCount; i++) {
+            if (slots[slotIndex].legs[i].retryAtMs == 0 || now < slots[slotIndex].legs[i].retryAtMs) continue;
+            slots[slotIndex].legs[i].retryAtMs = 0;
+            if (SendLegAsync(slots[slotIndex], i, slots[slotIndex].legs[i].sendPrice)) continue;
+            
+            retryExhausted++;
+            slots[slotIndex].placementFailed = true;
+            if (--slots[slotIndex].pendingAcks == 0) {
+               FinishAsyncPlacement(slotIndex);
+               break;
+            }
+         }
+         continue;
+      }
+      
+      LogMessage("[" + SignalIdOf(slots[slotIndex].sig.id) + "] " + IntegerToString(slots[slotIndex].pendingAcks) +
+                 " leg(s) not acknowledged within " + IntegerToString(AsyncAckTimeoutMs) + " ms");
+      // A reply may still come; whatever it placed is then removed in OnOrphanAck
+      for (int i = 0; i < slots[slotIndex].legCount; i++) {
+         slots[slotIndex].legs[i].retryAtMs = 0;
+         if (slots[slotIndex].legs[i].requestId == 0 || slots[slotIndex].legs[i].ticket != 0) continue;
+         if (orphanRequestIds[orphanAckNext] == 0) orphanAckCount++;
+         orphanRequestIds[orphanAckNext] = slots[slotIndex].legs[i].requestId;
+         orphanAckNext = (orphanAckNext + 1) % ORPHAN_ACK_SIZE;
+         slots[slotIndex].legs[i].requestId = 0;
+      }
+      slots[slotIndex].placementFailed = true;
+      slots[slotIndex].pendingAcks = 0;
+      FinishAsyncPlacement(slotIndex);
+   }
+}
+
+// Late reply to a request that timed out: its slot has rolled back, so
+// remove whatever the request placed instead of leaving it unmanaged
+void OnOrphanAck(const MqlTradeResult &result) {
+   for (int k = 0; k < ORPHAN_ACK_SIZE; k++) {
+      if (orphanRequestIds[k] != result.request_id) continue;
+      orphanRequestIds[k] = 0;
+      orphanAckCount--;
+      
+      bool placed = (result.retcode == TRADE_RETCODE_DONE || result.retcode == TRADE_RETCODE_PLACED ||
+                     result.retcode == TRADE_RETCODE_DONE_PARTIAL) && result.order != 0;
+      if (!placed) return;
+      
+      LogFmt(LOG_LEVEL_WARN, "Late placement ack for ticket %i after the timeout, removing it", (long)result.order);
+      if (UseLimitOrders && OrderSelect(result.order)) BrokerCancelOrder(result.order);
+      else if (PositionSelectByTicket(result.order)) BrokerClosePosition(result.order);
+      return;
+   }
+}
+
+// All-or-nothing, as in the synchronous path: keep every leg or roll back
+void FinishAsyncPlacement(int slotIndex) {
+   asyncPlacementsInFlight--;
+   
+   if (slots[slotIndex].placementFailed) {
+      for (int k = 0; k < slots[slotIndex].legCount; k++) {
+         if (slots[slotIndex].legs[k].ticket == 0) continue;
+         if (UseLimitOrders) BrokerCancelOrder(slots[slotIndex].legs[k].ticket);
+         else BrokerClosePosition(slots[slotIndex].legs[k].ticket);
+      }
+      LogMessage("[" + SignalIdOf(slots[slotIndex].sig.id) + "] Async placement failed, rolled back. Failed to process signal");
+      ReleaseSlot(slotIndex);
+      return;
+   }
+   
+   if (UseLimitOrders) slots[slotIndex].ordersPlaced = true;
+   else slots[slotIndex].tradesOpened = true;
+   
+   CompileTrailActions(slots[slotIndex]);
+   OnSlotPlaced(slots[slotIndex]);
+}
+
+// The single validation stage. Runs once per signal, before a slot is taken,
+// against the cached symbol spec. Prices are snapped to the tick size in
+// place, and every check the broker would apply (level order, stops level,
+// freeze level, limit side of the market) is made here, so an illegal order
+// is rejected locally instead of costing a failed send and a rollback.
+bool ValidateSignalParams(SignalRecord &s) {
+   s.validated = false;
+   int sym = s.sym;
+   
+   s.entry = NormalizePoints(sym, s.entry);
+   s.sl = NormalizePoints(sym, s.sl);
+   s.tp1 = NormalizePoints(sym, s.tp1);
+   s.tp2 = NormalizePoints(sym, s.tp2);
+   
+   long dir = s.direction;
+   if ((s.entry - s.sl) * dir <= 0 || (s.tp1 - s.entry) * dir <= 0 || (s.tp2 - s.tp1) * dir <= 0) {
+      LogWarn("Invalid " + DirectionName(s.direction) + " signal levels");
+      return false;
+   }
+   
+   double bid, ask;
+   if (replayActive) {
+      bid = replayTick.bid;
+      ask = replayTick.ask;
+   } else {
+      MqlTick tick;
+      if (!SymbolInfoTick(symbolSpecs[sym].name, tick)) {
+         LogWarn("No quote for " + symbolSpecs[sym].name);
+         return false;
+      }
+      bid = tick.bid;
+      ask = tick.ask;
+   }
+   
+   // Everything below is in points; stops and freeze levels already are
+   long current = PriceToPoints(sym, dir > 0 ? ask : bid);
+   long minStop = symbolSpecs[sym].stopsLevel;
+   long minFreeze = symbolSpecs[sym].freezeLevel;
+   int digits = symbolSpecs[sym].digits;
+   
+   if (UseLimitOrders) {
+      // For limit orders, entry should be below (BUY) or above (SELL) the current price
+      if ((current - s.entry) * dir <= 0) {
+         LogMessage(DirectionName(s.direction) + " limit order entry price should be " + (dir > 0 ? "below" : "above") + " current price");
+         return false;
+      }
+      if ((current - s.entry) * dir < MathMax(minStop, minFreeze)) {
+         LogMessage(DirectionName(s.direction) + " limit entry " + DoubleToString(PointsToPrice(sym, s.entry), digits) +
+                    " is inside the stops/freeze level of the current price");
+         return false;
+      }
+   }
+   
+   // SL and TP are measured from the fill price: the entry for limits, the
+   // opposite side of the spread for market orders
+   long fillRef = UseLimitOrders ? s.entry : current;
+   long exitRef = UseLimitOrders ? s.entry : PriceToPoints(sym, dir > 0 ? bid : ask);
+   if ((exitRef - s.sl) * dir < minStop || (s.tp1 - exitRef) * dir < minStop) {
+      LogMessage("SL or TP1 is closer than the stops level (" + IntegerToString(minStop) +
+                 " points) to " + DoubleToString(PointsToPrice(sym, fillRef), digits));
+      return false;
+   }
+   
+   s.validated = true;
+   return true;
+}
+
+// Snap a fixed-point price in points to the symbol's tick size
+long NormalizePoints(int sym, long points) {
+   long tickPoints = (long)MathRound(symbolSpecs[sym].tickSize / symbolSpecs[sym].point);
+   if (tickPoints <= 1) return points;
+   return (long)MathRound((double)points / tickPoints) * tickPoints;
+}
+
+// Snap a price to the symbol's tick size
+double NormalizePrice(int sym, double price) {
+   double tick = symbolSpecs[sym].tickSize;
+   if (tick > 0) price = MathRound(price / tick) * tick;
+   return NormalizeDouble(price, symbolSpecs[sym].digits);
+}
+
+// LotSize scaled for this account, so instances following one fan-out leader
+// can size the same signal differently
+double AccountLots() {
+   double lots = LotSize * AccountLotScale;
+   if (LotScaleReferenceBalance > 0) lots *= AccountInfoDouble(ACCOUNT_BALANCE) / LotScaleReferenceBalance;
+   return lots;
+}
+
+// Round a volume down to the symbol's step and cap it at the max. Below the
+// minimum it is 0: rounding up would trade more than this account is scaled to.
+double NormalizeVolume(int sym, double lots) {
+   double step = symbolSpecs[sym].volumeStep;
+   if (step > 0) lots = MathFloor(lots / step + 1e-9) * step;
+   if (lots < symbolSpecs[sym].volumeMin - 1e-9) return 0;
+   return NormalizeDouble(MathMin(symbolSpecs[sym].volumeMax, lots), 8);
+}
+
+void SimulateIncomingSignal() {
+   SignalParams sig;
+   double currentPrice = SymbolInfoDouble(_Symbol, SYMBOL_BID);
+   
+   if (UseLimitOrders) {
+      // Example BUY LIMIT signal (entry below current price)
+      sig.signal = "BUY";
+      sig.entry = 3320 - 50 * _Point; // 5 pips below current price
+      sig.sl = 3310 - 50 * _Point;       // 5 pips below entry
+      sig.tp1 = 3321 + 100 * _Point;     // 10 pips above entry
+      sig.tp2 = 3322 + 200 * _Point;     // 20 pips above entry
+      
+      /* Example SELL LIMIT signal (entry above current price)
+      sig.signal = "SELL";
+      sig.entry = currentPrice + 50 * _Point; // 5 pips above current price
+      sig.sl = sig.entry + 50 * _Point;       // 5 pips above entry
+      sig.tp1 = sig.entry - 100 * _Point;     // 10 pips below entry
+      sig.tp2 = sig.entry - 200 * _Point;     // 20 pips below entry
+      */
+   } else {
+      // Original market order example
+      sig.signal = "BUY";
+      sig.entry = 3329.50;
+      sig.sl = 3320.00;
+      sig.tp1 = 3330.50;
+      sig.tp2 = 3332.50;
+   }
+   
+   sig.id = "SIM_" + IntegerToString(TimeCurrent());
+   sig.seq = 0;
+   sig.journalSeq = 0;
+   sig.command = "";
+   
+   SignalRecord record;
+   if (!CompileSignal(sig, record)) return;
+   int index = AcquireSlot(record);
+   if (index < 0) {
+      LogMessage("No free signal slot for simulation");
+      return;
+   }
+   
+   LogMessage("Processing " + sig.signal + " signal");
+   bool success = OpenSignalTrades(slots[index]);
+   
+   if (success) {
+      LogPlacementOutcome(slots[index]);
+   } else {
+      ReleaseSlot(index);
+      LogWarn("Failed to process signal");
+   }
+}
+
+// Time the single-pass tokenizer against the per-key StringFind helpers on a
+// payload padded with unrelated fields. The nested "tp1" keys also show the
+// legacy helpers picking up the wrong value.
+void BenchmarkSignalParser() {
+   string padding = "";
+   for (int i = 0; i < 200; i++) {
+      padding += "\"extra_" + IntegerToString(i) + "\": {\"note\": \"tp1 sl entry \\\"quoted\\\"\", \"value\": " +
+                 DoubleToString(i * 1.25, 2) + "e0, \"tp1\": " + IntegerToString(i) + ", \"tags\": [1, 2, 3]}, ";
+   }
+   string payload = "{" + padding + "\"signal\": \"BUY\", \"entry\": 3320.50, \"sl\": 3310.00, " +
+                    "\"tp1\": 3325.5, \"tp2\": 3.3305e3, \"timestamp\": \"2025-01-15T10:30:45\", " +
+                    "\"page_id\": \"bench-1\"}";
+   
+   int iterations = 2000;
+   SignalParams a, b;
+   
+   ulong t0 = GetMicrosecondCount();
+   for (int i = 0; i < iterations; i++) {
+      ParseSignalWithExtractHelpers(payload, a);
+   }
+   ulong legacyUs = GetMicrosecondCount() - t0;
+   
+   t0 = GetMicrosecondCount();
+   for (int i = 0; i < iterations; i++) {
+      int pos = 0;
+      TokenizeSignalJSON(payload, pos, b);
+   }
+   ulong tokenizerUs = GetMicrosecondCount() - t0;
+   
+   LogMessage("Parser benchmark: " + IntegerToString(StringLen(payload)) + " chars x " + IntegerToString(iterations) + " iterations");
+   LogMessage("  ExtractJSON helpers: " + DoubleToString((double)legacyUs * 1000.0 / iterations, 0) + " ns/op" +
+              " (tp1=" + DoubleToString(a.tp1, 2) + ")");
+   LogMessage("  Single-pass tokenizer: " + DoubleToString((double)tokenizerUs * 1000.0 / iterations, 0) + " ns/op" +
+              " (tp1=" + DoubleToString(b.tp1, 2) + ", tp2=" + DoubleToString(b.tp2, 2) + ")");
+}
+
+// Crash-safe state journal. Every slot transition appends a full snapshot of
+// that slot; releases and the feed cursor get their own small records. Each
+// frame is [length][record bytes][FNV-1a checksum] and is flushed at once,
+// so a crash can at worst tear the last frame, which the reader then drops.
+// On start the journal is replayed, settled against one pass over our orders
+// and positions, and rewritten compacted.
+void JournalAppend(JournalRecord &rec) {
+   if (journalFile == INVALID_HANDLE || replayActive) return;
+   
+   uchar bytes[];
+   StructToCharArray(rec, bytes);
+   FileWriteInteger(journalFile, ArraySize(bytes));
+   FileWriteArray(journalFile, bytes);
+   FileWriteInteger(journalFile, (int)JournalChecksum(bytes));
+   FileFlush(journalFile);
+   
+   if (FileTell(journalFile) > JOURNAL_COMPACT_BYTES) JournalCompact();
+}
+
+uint JournalChecksum(const uchar &bytes[], int count = WHOLE_ARRAY) {
+   uint hash = 2166136261;
+   int n = count == WHOLE_ARRAY ? ArraySize(bytes) : MathMin(count, ArraySize(bytes));
+   for (int i = 0; i < n; i++) {
+      hash = (hash ^ bytes[i]) * 16777619;
+   }
+   return hash;
+}
+
+void JournalSlot(SignalSlot &slot) {
+   slot.journalDirty = false;
+   if (journalFile == INVALID_HANDLE || replayActive) return;
+   
+   JournalRecord rec;
+   ZeroMemory(rec);
+   rec.type = JOURNAL_SLOT;
+   rec.direction = (char)slot.direction;
+   rec.legCount = (uchar)slot.legCount;
+   rec.stepCount = (uchar)slot.stepCount;
+   rec.seq = slot.sig.seq;
+   rec.entry = PointsToPrice(slot.sym, slot.sig.entry);
+   rec.sl = PointsToPrice(slot.sym, slot.sig.sl);
+   rec.tp1 = PointsToPrice(slot.sym, slot.sig.tp1);
+   rec.tp2 = PointsToPrice(slot.sym, slot.sig.tp2);
+   StringToCharArray(SignalIdOf(slot.sig.id), rec.id, 0, JOURNAL_ID_LEN - 1);
+   StringToCharArray(symbolSpecs[slot.sym].name, rec.symbol, 0, JOURNAL_SYMBOL_LEN - 1);
+   for (int j = 0; j < slot.stepCount; j++) {
+      rec.stepTrigger[j] = slot.stepTrigger[j];
+      rec.stepSL[j] = slot.stepSL[j];
+   }
+   for (int i = 0; i < slot.legCount; i++) {
+      rec.legs[i].ticket = slot.legs[i].ticket;
+      rec.legs[i].tp = slot.legs[i].tp;
+      rec.legs[i].sl = slot.legs[i].sl;
+      rec.legs[i].lots = slot.legs[i].lots;
+      rec.legs[i].trailMask = slot.legs[i].trailMask;
+      rec.legs[i].trailDone = slot.legs[i].trailDone;
+      rec.legs[i].flags = slot.legs[i].flags;
+   }
+   JournalAppend(rec);
+}
+
+// Slots whose trail progress changed on a tick since the last timer pass
+void JournalDirtySlots() {
+   for (int i = 0; i < liveSlotCount; i++) {
+      if (slots[liveSlots[i]].journalDirty) JournalSlot(slots[liveSlots[i]]);
+   }
+}
+
+void JournalRelease(string signalId) {
+   if (journalFile == INVALID_HANDLE || replayActive) return;
+   
+   JournalRecord rec;
+   ZeroMemory(rec);
+   rec.type = JOURNAL_RELEASE;
+   StringToCharArray(signalId, rec.id, 0, JOURNAL_ID_LEN - 1);
+   JournalAppend(rec);
+}
+
+// Only written when the cursors or the last processed id actually moved. Both
+// cursors stay behind signals still waiting in the intake queue.
+void JournalCursor() {
+   if (journalFile == INVALID_HANDLE || replayActive) return;
+   
+   long feed = IntakeSafeFeedCursor();
+   if (feed != journaledFeedCursor) {
+      JournalRecord feedRec;
+      ZeroMemory(feedRec);
+      feedRec.type = JOURNAL_FEED;
+      feedRec.seq = feed;
+      JournalAppend(feedRec);
+      journaledFeedCursor = feed;
+   }
+   
+   if (lastCommandId != journaledCommandId) {
+      JournalRecord cmdRec;
+      ZeroMemory(cmdRec);
+      cmdRec.type = JOURNAL_COMMAND;
+      cmdRec.seq = lastCommandSeq;
+      StringToCharArray(lastCommandId, cmdRec.id, 0, JOURNAL_ID_LEN - 1);
+      JournalAppend(cmdRec);
+      journaledCommandId = lastCommandId;
+   }
+   
+   long cursor = IntakeSafeCursor();
+   if (cursor == journaledCursor && lastProcessedSignalId == journaledSignalId) return;
+   
+   JournalRecord rec;
+   ZeroMemory(rec);
+   rec.type = JOURNAL_CURSOR;
+   rec.seq = cursor;
+   StringToCharArray(lastProcessedSignalId, rec.id, 0, JOURNAL_ID_LEN - 1);
+   JournalAppend(rec);
+   
+   journaledCursor = cursor;
+   journaledSignalId = lastProcessedSignalId;
+}
+
+// Rewrite the journal as the cursor plus one record per live slot
+void JournalCompact() {
+   if (journalFile != INVALID_HANDLE) FileClose(journalFile);
+   
+   string tmp = StateJournalFile + ".tmp";
+   journalFile = FileOpen(tmp, FILE_WRITE | FILE_BIN);
+   if (journalFile == INVALID_HANDLE) {
+      LogError("Failed to open " + tmp + ". Error: " + IntegerToString(GetLastError()) + ". State journal disabled.");
+      return;
+   }
+   
+   journaledCursor = -1;
+   journaledFeedCursor = -1;
+   journaledCommandId = "";
+   JournalCursor();
+   for (int i = 0; i < liveSlotCount; i++) JournalSlot(slots[liveSlots[i]]);
+   FileClose(journalFile);
+   journalFile = INVALID_HANDLE;
+   
+   if (!FileMove(tmp, 0, StateJournalFile, FILE_REWRITE)) {
+      LogError("Failed to replace " + StateJournalFile + ". Error: " + IntegerToString(GetLastError()) + ". State journal disabled.");
+      return;
+   }
+   
+   journalFile = FileOpen(StateJournalFile, FILE_READ | FILE_WRITE | FILE_BIN);
+   if (journalFile != INVALID_HANDLE) FileSeek(journalFile, 0, SEEK_END);
+}
+
+// Replay the journal into the slot table, settle it against the terminal and
+// start a fresh compacted journal
+void RecoverState() {
+   ulong t0 = GetMicrosecondCount();
+   int records = 0;
+   
+   int handle = FileOpen(StateJournalFile, FILE_READ | FILE_BIN | FILE_SHARE_READ);
+   if (handle != INVALID_HANDLE) {
+      JournalRecord rec;
+      uchar bytes[];
+      int expected = sizeof(JournalRecord);
+      
+      while (!FileIsEnding(handle)) {
+         int len = FileReadInteger(handle);
+         if (len != expected || FileReadArray(handle, bytes, 0, len) != len) break;
+         uint checksum = (uint)FileReadInteger(handle);
+         if (checksum != JournalChecksum(bytes)) break;
+         
+         CharArrayToStruct(rec, bytes);
+         ApplyJournalRecord(rec);
+         records++;
+      }
+      if (!FileIsEnding(handle)) LogWarn("State journal has a torn or unreadable tail after " + IntegerToString(records) + " records");
+      FileClose(handle);
+   }
+   
+   int unmanaged = ReconcileRecoveredSlots();
+   
+   if (lastProcessedSignalId != "") DedupRemember(lastProcessedSignalId);
+   if (lastCommandId != "") DedupRemember(lastCommandId);
+   for (int i = 0; i < liveSlotCount; i++) DedupRemember(SignalIdOf(slots[liveSlots[i]].sig.id));
+   
+   journaledCursor = signalCursor;
+   journaledFeedCursor = feedCursor;
+   journaledSignalId = lastProcessedSignalId;
+   JournalCompact();
+   
+   if (records > 0 || unmanaged > 0) {
+      LogMessage("Recovered " + IntegerToString(liveSlotCount) + " signals from " + IntegerToString(records) +
+                 " journal records in " + IntegerToString(GetMicrosecondCount() - t0) + " us, cursor " +
+                 IntegerToString(signalCursor) + ", last signal " + lastProcessedSignalId);
+   }
+   if (unmanaged > 0) {
+      LogWarn(IntegerToString(unmanaged) + " orders/positions with magic " + IntegerToString(MagicNumber) +
+              " are not in the state journal and stay unmanaged");
+   }
+}
+
+void ApplyJournalRecord(JournalRecord &rec) {
+   string id = CharArrayToString(rec.id);
+   
+   if (rec.type == JOURNAL_CURSOR) {
+      signalCursor = MathMax(signalCursor, rec.seq);
+      lastProcessedSignalId = id;
+      return;
+   }
+   if (rec.type == JOURNAL_FEED) {
+      feedCursor = rec.seq;
+      return;
+   }
+   if (rec.type == JOURNAL_COMMAND) {
+      lastCommandId = id;
+      lastCommandSeq = rec.seq;
+      return;
+   }
    
-   // Validate required fields
-   if (signal.entry == 0 || signal.sl == 0 || signal.tp1 == 0 || signal.tp2 == 0) {
-      LogMessage("Missing required price levels in JSON");
-      return false;
+   int index = FindSlotBySignalId(id);
+   if (rec.type == JOURNAL_RELEASE) {
+      if (index >= 0) ReleaseSlot(index);
+      return;
    }
+   if (rec.type != JOURNAL_SLOT) return;
    
-   if (signal.id == "") {
-      // Generate ID if not provided
-      signal.id = IntegerToString(TimeCurrent()) + "_" + signal.signal;
+   string symbol = CharArrayToString(rec.symbol);
+   int sym = FindSymbolSpec(symbol);
+   if (sym < 0) {
+      LogWarn("Cannot recover " + id + ": symbol " + symbol + " is no longer in TradeSymbols");
+      if (index >= 0) ReleaseSlot(index);
+      return;
    }
    
-   LogMessage("Parsed signal: " + signal.signal + " Entry:" + DoubleToString(signal.entry, _Digits) + 
-             " SL:" + DoubleToString(signal.sl, _Digits) + 
-             " TP1:" + DoubleToString(signal.tp1, _Digits) + 
-             " TP2:" + DoubleToString(signal.tp2, _Digits));
+   // A later snapshot of a slot already recovered replaces it in place
+   SignalRecord sig;
+   sig.direction = rec.direction > 0 ? SIGNAL_DIR_BUY : SIGNAL_DIR_SELL;
+   sig.sym = sym;
+   sig.entry = PriceToPoints(sym, rec.entry);
+   sig.sl = PriceToPoints(sym, rec.sl);
+   sig.tp1 = PriceToPoints(sym, rec.tp1);
+   sig.tp2 = PriceToPoints(sym, rec.tp2);
+   sig.id = InternSignalId(id);
+   sig.seq = rec.seq;
+   sig.postedMs = 0;
+   sig.journalSeq = 0;
+   sig.command = "";
+   sig.validated = true;
    
-   return true;
+   if (index < 0) index = AcquireSlot(sig);
+   if (index < 0) {
+      LogWarn("No free signal slot to recover " + id);
+      return;
+   }
+   slots[index].sig = sig;
+   slots[index].stepCount = rec.stepCount;
+   for (int j = 0; j < rec.stepCount; j++) {
+      slots[index].stepTrigger[j] = rec.stepTrigger[j];
+      slots[index].stepSL[j] = rec.stepSL[j];
+   }
+   slots[index].legCount = rec.legCount;
+   for (int i = 0; i < rec.legCount; i++) {
+      slots[index].legs[i].ticket = rec.legs[i].ticket;
+      slots[index].legs[i].tp = rec.legs[i].tp;
+      slots[index].legs[i].sl = rec.legs[i].sl;
+      slots[index].legs[i].lots = rec.legs[i].lots;
+      slots[index].legs[i].flags = rec.legs[i].flags;
+      slots[index].legs[i].trailMask = rec.legs[i].trailMask;
+      slots[index].legs[i].trailDone = rec.legs[i].trailDone;
+      slots[index].legs[i].requestId = 0;
+      slots[index].legs[i].sentUs = 0;
+      slots[index].legs[i].ackUs = 0;
+      slots[index].legs[i].fillUs = 0;
+   }
 }
 
-// NEW: Helper function to extract string from JSON
-string ExtractJSONString(string json, string key) {
-   string searchPattern = "\"" + key + "\"";
-   int startPos = StringFind(json, searchPattern);
-   if (startPos == -1) return "";
+// One pass over our orders and positions instead of probing ticket by ticket.
+// Returns how many of them the journal does not know about.
+int ReconcileRecoveredSlots() {
+   for (int i = 0; i < liveSlotCount; i++) {
+      int slotIndex = liveSlots[i];
+      for (int leg = 0; leg < slots[slotIndex].legCount; leg++) {
+         if ((slots[slotIndex].legs[leg].flags & LEG_ACTIVE) != 0) {
+            TicketIndexPut(slots[slotIndex].legs[leg].ticket, slotIndex, leg);
+         }
+      }
+   }
    
-   startPos = StringFind(json, ":", startPos);
-   if (startPos == -1) return "";
+   uchar seen[MAX_SIGNAL_SLOTS * MAX_LEGS]; // 0 gone, 1 pending order, 2 position
+   double openPrice[MAX_SIGNAL_SLOTS * MAX_LEGS];
+   ArrayInitialize(seen, 0);
+   int unmanaged = 0;
    
-   startPos = StringFind(json, "\"", startPos);
-   if (startPos == -1) return "";
-   startPos++; // Move past opening quote
+   for (int i = OrdersTotal() - 1; i >= 0; i--) {
+      ulong ticket = OrderGetTicket(i);
+      if (ticket == 0 || OrderGetInteger(ORDER_MAGIC) != MagicNumber) continue;
+      
+      int ref = TicketIndexFind(ticket);
+      if (ref < 0) unmanaged++;
+      else seen[ref] = 1;
+   }
    
-   int endPos = StringFind(json, "\"", startPos);
-   if (endPos == -1) return "";
+   for (int i = PositionsTotal() - 1; i >= 0; i--) {
+      if (PositionGetTicket(i) == 0 || PositionGetInteger(POSITION_MAGIC) != MagicNumber) continue;
+      
+      // Legs keep the opening order ticket, which is the position identifier
+      int ref = TicketIndexFind(PositionGetInteger(POSITION_IDENTIFIER));
+      if (ref < 0) {
+         unmanaged++;
+         continue;
+      }
+      seen[ref] = 2;
+      openPrice[ref] = PositionGetDouble(POSITION_PRICE_OPEN);
+      double sl = PositionGetDouble(POSITION_SL);
+      if (sl > 0) slots[ref / MAX_LEGS].legs[ref % MAX_LEGS].sl = sl;
+   }
    
-   return StringSubstr(json, startPos, endPos - startPos);
+   for (int i = liveSlotCount - 1; i >= 0; i--) {
+      int slotIndex = liveSlots[i];
+      
+      for (int leg = 0; leg < slots[slotIndex].legCount && slots[slotIndex].inUse; leg++) {
+         if ((slots[slotIndex].legs[leg].flags & LEG_ACTIVE) == 0) continue;
+         
+         int ref = slotIndex * MAX_LEGS + leg;
+         if (seen[ref] == 0) MarkLegClosed(slotIndex, leg, "closed while offline");
+         else if (seen[ref] == 2) MarkLegFilled(slotIndex, leg, openPrice[ref]);
+      }
+      
+      if (slots[slotIndex].inUse) {
+         CompileTrailActions(slots[slotIndex]);
+         RefreshSlotState(slotIndex);
+      }
+   }
+   
+   return unmanaged;
 }
 
-// NEW: Helper function to extract double from JSON
-double ExtractJSONDouble(string json, string key) {
-   string searchPattern = "\"" + key + "\"";
-   int startPos = StringFind(json, searchPattern);
-   if (startPos == -1) return 0;
+// Micro-benchmarks for the per-signal and per-tick functions on synthetic
+// payloads and ticks. Trading calls go to the replay paper book, so nothing
+// reaches the broker. MQL5 has no allocation counter, so memory is reported
+// as the MQL_MEMORY_USED delta, which is only MB-granular. Returns false when
+// the tick path costs more than BenchTickBudgetNs per tick.
+bool RunBenchmarkSuite() {
+   int n = MathMax(BenchIterations, 1000);
    
-   startPos = StringFind(json, ":", startPos);
-   if (startPos == -1) return 0;
+   // Bench output only; keep records from before the run and drop the rest
+   FlushLog(LOG_RING_SIZE);
+   int savedDropped = logDropped;
    
-   // Skip whitespace and quotes
-   startPos++;
-   while (startPos < StringLen(json) && (StringGetCharacter(json, startPos) == ' ' || 
-          StringGetCharacter(json, startPos) == '"')) {
-      startPos++;
+   // The fixture trades the first TradeSymbols entry (a signal without a
+   // "symbol"), priced in its points off its current quote: a BUY limit 450
+   // points under the bid, SL 1050 points under the entry, TPs 500 and 1000
+   // points over it
+   string name = symbolSpecs[0].name;
+   double pt = symbolSpecs[0].point;
+   int digits = symbolSpecs[0].digits;
+   MqlTick quote;
+   if (!SymbolInfoTick(name, quote) || quote.bid <= 0) {
+      LogError("Benchmark: no quote for " + name);
+      return false;
    }
+   double spread = MathMax(quote.ask - quote.bid, pt);
+   double entry = NormalizeDouble(quote.bid - 450 * pt, digits);
    
-   // Find end of number
-   int endPos = startPos;
-   while (endPos < StringLen(json)) {
-      ushort ch = StringGetCharacter(json, endPos);
-      if (ch != '.' && ch != '-' && (ch < '0' || ch > '9')) {
-         break;
-      }
-      endPos++;
+   replayActive = true;
+   ZeroMemory(replayTick);
+   replayTick.time_msc = (long)TimeCurrent() * 1000;
+   replayTick.bid = quote.bid;
+   replayTick.ask = quote.bid + spread;
+   
+   string payload = "{\"signal\": \"BUY\", \"entry\": " + DoubleToString(entry, digits) +
+                    ", \"sl\": " + DoubleToString(entry - 1050 * pt, digits) +
+                    ", \"tp1\": " + DoubleToString(entry + 500 * pt, digits) +
+                    ", \"tp2\": " + DoubleToString(entry + 1000 * pt, digits) +
+                    ", \"timestamp\": \"2025-01-15T10:30:45\", \"page_id\": \"bench-1\"}";
+   SignalParams sig;
+   SignalRecord record;
+   string results[];
+   
+   int setupPos = 0;
+   if (!ParseSignalFromJSON(payload, setupPos, sig) || !CompileSignal(sig, record)) {
+      LogError("Benchmark: the synthetic signal for " + name + " does not parse");
+      ResetAfterReplay();
+      return false;
    }
    
-   if (endPos > startPos) {
-      string numberStr = StringSubstr(json, startPos, endPos - startPos);
-      return StringToDouble(numberStr);
+   // The tokenizer alone: CompleteParsedSignal logs every signal it accepts,
+   // and that log line is not parse cost
+   SignalParams parsed;
+   long mem = MQLInfoInteger(MQL_MEMORY_USED);
+   ulong t0 = GetMicrosecondCount();
+   for (int i = 0; i < n; i++) {
+      int pos = 0;
+      TokenizeSignalJSON(payload, pos, parsed);
    }
+   BenchRecord(results, "TokenizeSignalJSON", n, GetMicrosecondCount() - t0, mem);
    
-   return 0;
-}
-
-
-void CheckOrderFills() {
-   // Check if orders have been converted to positions
-   bool order1_filled = false;
-   bool order2_filled = false;
-   bool order3_filled = false;
+   mem = MQLInfoInteger(MQL_MEMORY_USED);
+   t0 = GetMicrosecondCount();
+   for (int i = 0; i < n; i++) {
+      CompileSignal(sig, record);
+   }
+   BenchRecord(results, "CompileSignal", n, GetMicrosecondCount() - t0, mem);
    
-   // Check each order
-   if (order1.isActive && !order1.isPosition) {
-      if (!OrderSelect(order1.ticket)) {
-         // Order no longer exists, check if it became a position
-         if (PositionSelectByTicket(order1.ticket)) {
-            order1.isPosition = true;
-            order1_filled = true;
-            LogMessage("Order 1 filled and converted to position: " + IntegerToString(order1.ticket));
-         } else {
-            order1.isActive = false;
-            LogMessage("Order 1 expired or cancelled: " + IntegerToString(order1.ticket));
-         }
-      }
+   // Copies made per signal by the intake queue and slot hand-off
+   SignalParams paramsCopy[2];
+   SignalRecord recordCopy[2];
+   mem = MQLInfoInteger(MQL_MEMORY_USED);
+   t0 = GetMicrosecondCount();
+   for (int i = 0; i < n; i++) {
+      paramsCopy[i & 1] = sig;
    }
+   BenchRecord(results, "Signal copy (SignalParams, strings)", n, GetMicrosecondCount() - t0, mem);
    
-   if (order2.isActive && !order2.isPosition) {
-      if (!OrderSelect(order2.ticket)) {
-         if (PositionSelectByTicket(order2.ticket)) {
-            order2.isPosition = true;
-            order2_filled = true;
-            LogMessage("Order 2 filled and converted to position: " + IntegerToString(order2.ticket));
-         } else {
-            order2.isActive = false;
-            LogMessage("Order 2 expired or cancelled: " + IntegerToString(order2.ticket));
-         }
-      }
+   mem = MQLInfoInteger(MQL_MEMORY_USED);
+   t0 = GetMicrosecondCount();
+   for (int i = 0; i < n; i++) {
+      recordCopy[i & 1] = record;
    }
+   BenchRecord(results, "Signal copy (SignalRecord)", n, GetMicrosecondCount() - t0, mem);
    
-   if (order3.isActive && !order3.isPosition) {
-      if (!OrderSelect(order3.ticket)) {
-         if (PositionSelectByTicket(order3.ticket)) {
-            order3.isPosition = true;
-            order3_filled = true;
-            LogMessage("Order 3 filled and converted to position: " + IntegerToString(order3.ticket));
-         } else {
-            order3.isActive = false;
-            LogMessage("Order 3 expired or cancelled: " + IntegerToString(order3.ticket));
-         }
-      }
+   mem = MQLInfoInteger(MQL_MEMORY_USED);
+   t0 = GetMicrosecondCount();
+   for (int i = 0; i < n; i++) {
+      ValidateSignalParams(record);
    }
+   BenchRecord(results, "ValidateSignalParams", n, GetMicrosecondCount() - t0, mem);
    
-   // If any orders filled, mark trades as opened
-   if (order1_filled || order2_filled || order3_filled) {
-      tradesOpened = true;
-      LogMessage("At least one order filled. Trailing stops now active.");
+   mem = MQLInfoInteger(MQL_MEMORY_USED);
+   t0 = GetMicrosecondCount();
+   for (int i = 0; i < n; i++) {
+      LogFmt(LOG_LEVEL_INFO, "[%s] Leg %i filled and converted to position: %i", 1, 123456789, 0, sig.id);
    }
+   BenchRecord(results, "LogFmt (append)", n, GetMicrosecondCount() - t0, mem);
    
-   // If all orders are no longer pending, reset ordersPlaced
-   if (!order1.isActive && !order2.isActive && !order3.isActive) {
-      ordersPlaced = false;
-      LogMessage("All pending orders processed.");
+   LogRecord logRec;
+   logRec.level = LOG_LEVEL_INFO;
+   logRec.templated = true;
+   logRec.text = "%s: Moved SL to %p for leg %i (ticket: %i)";
+   logRec.i0 = 2;
+   logRec.i1 = 123456789;
+   logRec.p0 = entry;
+   logRec.digits = digits;
+   logRec.s0 = "BUY";
+   mem = MQLInfoInteger(MQL_MEMORY_USED);
+   t0 = GetMicrosecondCount();
+   for (int i = 0; i < n; i++) {
+      FormatLogRecord(logRec);
    }
-}
-
-void HandleBuyTrailingStops(double price) {
-   // When price reaches TP1, move SL of positions 2 & 3 to breakeven
-   if (price >= sig.tp1 && !order2.sl_moved_to_entry && !order3.sl_moved_to_entry) {
-      if (order2.isPosition && UpdateSL(order2.ticket, sig.entry)) {
-         order2.sl_moved_to_entry = true;
-         LogMessage("BUY: Moved SL to breakeven for position 2 (ticket: " + IntegerToString(order2.ticket) + ")");
-      }
-      if (order3.isPosition && UpdateSL(order3.ticket, sig.entry)) {
-         order3.sl_moved_to_entry = true;
-         LogMessage("BUY: Moved SL to breakeven for position 3 (ticket: " + IntegerToString(order3.ticket) + ")");
-      }
+   BenchRecord(results, "FormatLogRecord (flush)", n, GetMicrosecondCount() - t0, mem);
+   
+   // One live signal with every leg filled in the paper book
+   int index = AcquireSlot(record);
+   bool ok = index >= 0;
+   if (ok) {
+      ok = OpenSignalTrades(slots[index]);
+   }
+   if (!ok) {
+      LogError("Benchmark: could not place the synthetic signal");
+      ResetAfterReplay();
+      return false;
    }
+   replayTick.ask = sig.entry;
+   MatchPaperBook(sig.entry - spread, sig.entry);
+   int legCount = slots[index].legCount;
    
-   // When price reaches TP2, move SL of position 3 to TP1
-   if (price >= sig.tp2 && !order3.sl_moved_to_tp1) {
-      if (order3.isPosition && UpdateSL(order3.ticket, sig.tp1)) {
-         order3.sl_moved_to_tp1 = true;
-         LogMessage("BUY: Moved SL to TP1 for position 3 (ticket: " + IntegerToString(order3.ticket) + ")");
-      }
+   // Tick path: prices stay between entry and the first trigger, so this is
+   // the steady-state per-tick cost of fill matching plus the trail check
+   mem = MQLInfoInteger(MQL_MEMORY_USED);
+   t0 = GetMicrosecondCount();
+   for (int i = 0; i < n; i++) {
+      double bid = sig.entry + (i % 400) * pt;
+      MatchPaperBook(bid, bid + spread);
+      ManageBuySlots(0, bid);
+      ManageSellSlots(0, bid + spread);
    }
-}
-
-void HandleSellTrailingStops(double price) {
-   // When price reaches TP1, move SL of positions 2 & 3 to breakeven
-   if (price <= sig.tp1 && !order2.sl_moved_to_entry && !order3.sl_moved_to_entry) {
-      if (order2.isPosition && UpdateSL(order2.ticket, sig.entry)) {
-         order2.sl_moved_to_entry = true;
-         LogMessage("SELL: Moved SL to breakeven for position 2 (ticket: " + IntegerToString(order2.ticket) + ")");
-      }
-      if (order3.isPosition && UpdateSL(order3.ticket, sig.entry)) {
-         order3.sl_moved_to_entry = true;
-         LogMessage("SELL: Moved SL to breakeven for position 3 (ticket: " + IntegerToString(order3.ticket) + ")");
+   ulong tickUs = GetMicrosecondCount() - t0;
+   BenchRecord(results, "Tick path (MatchPaperBook + trail check)", n, tickUs, mem);
+   
+   // Trail check alone, against the two earlier shapes of the same loop: the
+   // direction read from the signal string, and one loop branching on the enum
+   string direction = sig.signal;
+   mem = MQLInfoInteger(MQL_MEMORY_USED);
+   t0 = GetMicrosecondCount();
+   for (int i = 0; i < n; i++) {
+      double bid = sig.entry + (i % 400) * pt;
+      for (int k = 0; k < liveSlotCount; k++) {
+         int idx = liveSlots[k];
+         double signedPrice = direction == "BUY" ? bid : -(bid + spread);
+         if (signedPrice >= slots[idx].nextTrigger) FireTrailActions(slots[idx], signedPrice);
       }
    }
+   BenchRecord(results, "Trail check (direction string compare)", n, GetMicrosecondCount() - t0, mem);
    
-   // When price reaches TP2, move SL of position 3 to TP1
-   if (price <= sig.tp2 && !order3.sl_moved_to_tp1) {
-      if (order3.isPosition && UpdateSL(order3.ticket, sig.tp1)) {
-         order3.sl_moved_to_tp1 = true;
-         LogMessage("SELL: Moved SL to TP1 for position 3 (ticket: " + IntegerToString(order3.ticket) + ")");
+   mem = MQLInfoInteger(MQL_MEMORY_USED);
+   t0 = GetMicrosecondCount();
+   for (int i = 0; i < n; i++) {
+      double bid = sig.entry + (i % 400) * pt;
+      for (int k = 0; k < liveSlotCount; k++) {
+         int idx = liveSlots[k];
+         double signedPrice = slots[idx].direction == SIGNAL_DIR_BUY ? bid : -(bid + spread);
+         if (signedPrice >= slots[idx].nextTrigger) FireTrailActions(slots[idx], signedPrice);
       }
    }
-}
-
-void UpdatePositionStates() {
-   // Update position status for filled orders
-   if (order1.isPosition) {
-      order1.isActive = PositionSelectByTicket(order1.ticket);
+   BenchRecord(results, "Trail check (one loop, direction branch)", n, GetMicrosecondCount() - t0, mem);
+   
+   mem = MQLInfoInteger(MQL_MEMORY_USED);
+   t0 = GetMicrosecondCount();
+   for (int i = 0; i < n; i++) {
+      double bid = sig.entry + (i % 400) * pt;
+      ManageBuySlots(0, bid);
+      ManageSellSlots(0, bid + spread);
    }
-   if (order2.isPosition) {
-      order2.isActive = PositionSelectByTicket(order2.ticket);
+   BenchRecord(results, "Trail check (per-direction loops)", n, GetMicrosecondCount() - t0, mem);
+   
+   // Every trail step on every leg: compile, fire, UpdateSL
+   mem = MQLInfoInteger(MQL_MEMORY_USED);
+   t0 = GetMicrosecondCount();
+   for (int i = 0; i < n; i++) {
+      for (int leg = 0; leg < slots[index].legCount; leg++) {
+         slots[index].legs[leg].sl = sig.sl;
+         slots[index].legs[leg].trailDone = 0;
+      }
+      CompileTrailActions(slots[index]);
+      if (slots[index].actionCount > 0) FireTrailActions(slots[index], slots[index].actions[slots[index].actionCount - 1].trigger);
    }
-   if (order3.isPosition) {
-      order3.isActive = PositionSelectByTicket(order3.ticket);
+   BenchRecord(results, "Trail ladder (compile + fire + UpdateSL)", n, GetMicrosecondCount() - t0, mem);
+   
+   // Fill handling as routed from a transaction: index lookup + MarkLegFilled
+   ulong ticket = slots[index].legs[0].ticket;
+   mem = MQLInfoInteger(MQL_MEMORY_USED);
+   t0 = GetMicrosecondCount();
+   for (int i = 0; i < n; i++) {
+      slots[index].legs[0].flags = LEG_ACTIVE;
+      int ref = TicketIndexFind(ticket);
+      if (ref >= 0) MarkLegFilled(ref / MAX_LEGS, ref % MAX_LEGS, sig.entry);
    }
+   BenchRecord(results, "Fill handling (TicketIndexFind + MarkLegFilled)", n, GetMicrosecondCount() - t0, mem);
+   
+   ResetAfterReplay();
+   logHead = (logHead + logCount) % LOG_RING_SIZE;
+   logCount = 0;
+   logDropped = savedDropped;
    
-   // Check if all positions are closed
-   if (order1.isPosition && order2.isPosition && order3.isPosition &&
-       !order1.isActive && !order2.isActive && !order3.isActive) {
-      tradesOpened = false;
-      ordersPlaced = false;
-      LogMessage("All positions closed. Ready for new signal.");
+   LogMessage("Benchmark suite: " + IntegerToString(n) + " iterations, " + IntegerToString(legCount) + " legs");
+   for (int i = 0; i < ArraySize(results); i++) LogMessage(results[i]);
+   
+   double tickNs = tickUs * 1000.0 / n;
+   if (BenchTickBudgetNs > 0 && tickNs > BenchTickBudgetNs) {
+      LogError("Benchmark: tick path " + DoubleToString(tickNs, 0) + " ns/tick exceeds budget of " +
+               IntegerToString(BenchTickBudgetNs) + " ns");
+      return false;
    }
+   return true;
+}
+
+void BenchRecord(string &results[], string name, int n, ulong elapsedUs, long memBefore) {
+   int i = ArraySize(results);
+   ArrayResize(results, i + 1);
+   results[i] = StringFormat("  %-48s %10.0f ns/op  %+d MB", name, elapsedUs * 1000.0 / n,
+                             MQLInfoInteger(MQL_MEMORY_USED) - memBefore);
 }
 
-bool UpdateSL(ulong ticket, double new_sl) {
-   if (!PositionSelectByTicket(ticket)) {
-      LogMessage("Error: Position not found for ticket " + IntegerToString(ticket));
+// Flatten: close every position and delete every pending order carrying
+// MagicNumber, strays no slot knows about included. All requests go out at
+// once with OrderSendAsync, and a target only counts as gone once its deal or
+// order history record arrives in OnTradeTransaction; the slots release
+// themselves through the usual leg transitions. When a round is done the
+// terminal is scanned again, so positions that appeared meanwhile (an order
+// filling before its delete landed, a late async placement) are caught, up to
+// FLATTEN_MAX_ROUNDS rounds of AsyncAckTimeoutMs each.
+bool StartFlatten(string reason) {
+   if (flattenActive) {
+      LogMessage("Flatten already in progress, ignoring " + reason);
       return false;
    }
    
-   double current_sl = PositionGetDouble(POSITION_SL);
-   double tp = PositionGetDouble(POSITION_TP);
+   flattenActive = true;
+   flattenStartUs = GetMicrosecondCount();
+   flattenRounds = 0;
+   flattenRequests = 0;
+   flattenRuns++;
+   LogMessage("Flatten requested (" + reason + ")");
    
-   // Avoid unnecessary modifications
-   if (MathAbs(current_sl - new_sl) < _Point) {
-      return true; // Already at target SL
+   // Nothing queued before the command may open once the book is flat
+   if (intakeCount > 0) {
+      LogFmt(LOG_LEVEL_WARN, "Flatten: dropping %i queued signals", intakeCount);
+      intakeCount = 0;
+      JournalCursor();
    }
    
-   // Validate SL direction
-   ENUM_POSITION_TYPE pos_type = (ENUM_POSITION_TYPE)PositionGetInteger(POSITION_TYPE);
-   if (pos_type == POSITION_TYPE_BUY && new_sl <= current_sl) {
-      return true; // Don't move SL backwards for BUY
-   }
-   if (pos_type == POSITION_TYPE_SELL && new_sl >= current_sl) {
-      return true; // Don't move SL backwards for SELL
+   // Placements still waiting on replies roll back when they complete
+   for (int i = 0; i < liveSlotCount; i++) {
+      if (slots[liveSlots[i]].pendingAcks > 0) slots[liveSlots[i]].placementFailed = true;
    }
    
-   bool result = trade.PositionModify(ticket, new_sl, tp);
-   if (!result) {
-      LogMessage("Error modifying position " + IntegerToString(ticket) + ": " + 
-                IntegerToString(trade.ResultRetcode()) + " - " + trade.ResultRetcodeDescription());
-   }
-   return result;
+   FlattenRound();
+   return true;
 }
 
-bool OpenSignalTrades(SignalParams &s) {
-   // Validate signal parameters
-   if (!ValidateSignalParams(s)) {
-      LogMessage("Error: Invalid signal parameters");
-      return false;
-   }
-   
-   trade.SetExpertMagicNumber(MagicNumber);
-   trade.SetDeviationInPoints(SlippagePoints);
+void FlattenRound() {
+   flattenRounds++;
+   flattenTargetCount = 0;
    
-   // Calculate TP3 based on signal direction
-   double tp3;
-   if (s.signal == "BUY") {
-      tp3 = s.tp1 + TP3_Offset * _Point;
-   } else {
-      tp3 = s.tp1 - TP3_Offset * _Point;
+   for (int i = PositionsTotal() - 1; i >= 0 && flattenTargetCount < FLATTEN_MAX_TARGETS; i--) {
+      ulong ticket = PositionGetTicket(i);
+      if (ticket == 0 || PositionGetInteger(POSITION_MAGIC) != MagicNumber) continue;
+      FlattenAddTarget(ticket, true);
    }
    
-   // Calculate expiration time
-   datetime expiration = TimeCurrent() + OrderExpirationHours * 3600;
-   
-   LogMessage("Placing " + s.signal + " " + (UseLimitOrders ? "LIMIT" : "MARKET") + 
-             " orders at " + DoubleToString(s.entry, _Digits));
-   
-   bool success = false;
+   for (int i = OrdersTotal() - 1; i >= 0 && flattenTargetCount < FLATTEN_MAX_TARGETS; i--) {
+      ulong ticket = OrderGetTicket(i);
+      if (ticket == 0 || OrderGetInteger(ORDER_MAGIC) != MagicNumber) continue;
+      FlattenAddTarget(ticket, false);
+   }
    
-   if (UseLimitOrders) {
-      success = PlaceLimitOrders(s, tp3, expiration);
-   } else {
-      success = PlaceMarketOrders(s, tp3);
+   if (flattenTargetCount == 0) {
+      FinishFlatten();
+      return;
    }
    
-   if (success) {
-      InitializeOrderStates();
-      LogMessage("Successfully placed 3 orders: " + 
-                IntegerToString(order1.ticket) + ", " + 
-                IntegerToString(order2.ticket) + ", " + 
-                IntegerToString(order3.ticket));
-
-      // send webhook request to update database (order is processed)
-      string r = "";
-      if(MakeWebRequest(r, WebhookUpdateURL)) {
-         LogMessage("send order update to database");
-      }
-      
+   flattenDeadlineMs = GetTickCount64() + (ulong)MathMax(AsyncAckTimeoutMs, 100);
+   flattenOpen = flattenTargetCount;
+   for (int k = 0; k < flattenTargetCount; k++) {
+      if (FlattenSend(k)) continue;
+      flattenTargets[k].done = true;
+      flattenOpen--;
    }
+   LogFmt(LOG_LEVEL_INFO, "Flatten round %i: %i closes and deletes sent", flattenRounds, flattenOpen);
    
-   return success;
+   if (flattenOpen == 0) FlattenRoundDone();
 }
 
-bool PlaceLimitOrders(SignalParams &s, double tp3, datetime expiration) {
-   ENUM_ORDER_TYPE orderType = s.signal == "BUY" ? ORDER_TYPE_BUY_LIMIT : ORDER_TYPE_SELL_LIMIT;
-   
-   // Place limit orders
-   order1.ticket = trade.OrderOpen(_Symbol, orderType, LotSize, 0, s.entry, s.sl, s.tp1, 
-                                  ORDER_TIME_SPECIFIED, expiration, "TP1 Limit Order");
-   if (order1.ticket == 0) {
-      LogMessage("Failed to place limit order 1: " + IntegerToString(trade.ResultRetcode()));
-      return false;
-   }
+void FlattenAddTarget(ulong ticket, bool position) {
+   int k = flattenTargetCount++;
+   flattenTargets[k].ticket = ticket;
+   flattenTargets[k].position = position;
+   flattenTargets[k].requestId = 0;
+   flattenTargets[k].attempts = 0;
+   flattenTargets[k].done = false;
+}
+
+// Send the close or delete for one target; false when it is already gone or
+// the request could not be sent
+bool FlattenSend(int k) {
+   MqlTradeRequest request;
+   MqlTradeResult result;
+   ZeroMemory(request);
+   ZeroMemory(result);
    
-   order2.ticket = trade.OrderOpen(_Symbol, orderType, LotSize, 0, s.entry, s.sl, s.tp2, 
-                                  ORDER_TIME_SPECIFIED, expiration, "TP2 Limit Order");
-   if (order2.ticket == 0) {
-      LogMessage("Failed to place limit order 2: " + IntegerToString(trade.ResultRetcode()));
-      trade.OrderDelete(order1.ticket);
-      return false;
+   ulong ticket = flattenTargets[k].ticket;
+   if (flattenTargets[k].position) {
+      if (!PositionSelectByTicket(ticket)) return false;
+      
+      string symbol = PositionGetString(POSITION_SYMBOL);
+      bool isBuy = PositionGetInteger(POSITION_TYPE) == POSITION_TYPE_BUY;
+      int sym = FindSymbolSpec(symbol);
+      request.action = TRADE_ACTION_DEAL;
+      request.position = ticket;
+      request.symbol = symbol;
+      request.volume = PositionGetDouble(POSITION_VOLUME);
+      request.type = isBuy ? ORDER_TYPE_SELL : ORDER_TYPE_BUY;
+      request.price = SymbolInfoDouble(symbol, isBuy ? SYMBOL_BID : SYMBOL_ASK);
+      request.deviation = SlippagePoints;
+      request.magic = MagicNumber;
+      request.type_filling = sym >= 0 ? symbolSpecs[sym].filling : SymbolFillingMode(symbol);
+      request.comment = "Flatten";
+   } else {
+      if (!OrderSelect(ticket)) return false;
+      
+      request.action = TRADE_ACTION_REMOVE;
+      request.order = ticket;
    }
    
-   order3.ticket = trade.OrderOpen(_Symbol, orderType, LotSize, 0, s.entry, s.sl, tp3, 
-                                  ORDER_TIME_SPECIFIED, expiration, "TP3 Limit Order");
-   if (order3.ticket == 0) {
-      LogMessage("Failed to place limit order 3: " + IntegerToString(trade.ResultRetcode()));
-      trade.OrderDelete(order1.ticket);
-      trade.OrderDelete(order2.ticket);
+   if (!OrderSendAsync(request, result)) {
+      LogFmt(LOG_LEVEL_ERROR, "Flatten: failed to send %s for %i: retcode %i", (long)ticket, result.retcode, 0,
+             flattenTargets[k].position ? "close" : "delete");
       return false;
    }
    
-   ordersPlaced = true;
+   flattenTargets[k].requestId = result.request_id;
+   flattenTargets[k].attempts++;
+   flattenRequests++;
    return true;
 }
 
-bool PlaceMarketOrders(SignalParams &s, double tp3) {
-   ENUM_ORDER_TYPE type = s.signal == "BUY" ? ORDER_TYPE_BUY : ORDER_TYPE_SELL;
-   
-   // Place market orders (original behavior)
-   order1.ticket = trade.PositionOpen(_Symbol, type, LotSize, s.entry, s.sl, s.tp1, "TP1 Trade");
-   if (order1.ticket == 0) {
-      LogMessage("Failed to open position 1: " + IntegerToString(trade.ResultRetcode()));
-      return false;
+int FindFlattenTarget(ulong ticket, bool position) {
+   for (int k = 0; k < flattenTargetCount; k++) {
+      if (flattenTargets[k].ticket == ticket && flattenTargets[k].position == position && !flattenTargets[k].done) return k;
    }
-   
-   order2.ticket = trade.PositionOpen(_Symbol, type, LotSize, s.entry, s.sl, s.tp2, "TP2 Trade");
-   if (order2.ticket == 0) {
-      LogMessage("Failed to open position 2: " + IntegerToString(trade.ResultRetcode()));
-      trade.PositionClose(order1.ticket);
-      return false;
+   return -1;
+}
+
+void FlattenTargetDone(int k) {
+   flattenTargets[k].done = true;
+   flattenTargets[k].requestId = 0;
+   if (--flattenOpen == 0) FlattenRoundDone();
+}
+
+void FlattenRoundDone() {
+   if (flattenRounds < FLATTEN_MAX_ROUNDS) FlattenRound();
+   else FinishFlatten();
+}
+
+// Server replies, fills, closes and deletes of flatten targets
+void ApplyFlattenTransaction(const MqlTradeTransaction &trans, const MqlTradeResult &result) {
+   if (trans.type == TRADE_TRANSACTION_REQUEST) {
+      int k = -1;
+      for (int i = 0; i < flattenTargetCount && k < 0; i++) {
+         if (flattenTargets[i].requestId == result.request_id && !flattenTargets[i].done) k = i;
+      }
+      // Accepted requests are confirmed by the deal or history record
+      if (k < 0 || result.retcode == TRADE_RETCODE_DONE || result.retcode == TRADE_RETCODE_DONE_PARTIAL ||
+          result.retcode == TRADE_RETCODE_PLACED) return;
+      
+      if (IsTransientRetcode(result.retcode) && flattenTargets[k].attempts <= MaxRetriesPerLeg && FlattenSend(k)) return;
+      LogFmt(LOG_LEVEL_WARN, "Flatten: %s of %i rejected, retcode %i", (long)flattenTargets[k].ticket, result.retcode, 0,
+             flattenTargets[k].position ? "close" : "delete");
+      // Still there? The next round's scan picks it up again
+      FlattenTargetDone(k);
+   } else if (trans.type == TRADE_TRANSACTION_DEAL_ADD) {
+      if (!HistoryDealSelect(trans.deal)) return;
+      ENUM_DEAL_ENTRY entry = (ENUM_DEAL_ENTRY)HistoryDealGetInteger(trans.deal, DEAL_ENTRY);
+      
+      if (entry == DEAL_ENTRY_OUT || entry == DEAL_ENTRY_OUT_BY) {
+         int k = FindFlattenTarget(trans.position, true);
+         if (k >= 0 && !PositionSelectByTicket(trans.position)) FlattenTargetDone(k);
+      } else if (entry == DEAL_ENTRY_IN) {
+         // A pending order filled before its delete landed: close the position
+         int k = FindFlattenTarget(trans.order, false);
+         if (k < 0) return;
+         flattenTargets[k].ticket = trans.position;
+         flattenTargets[k].position = true;
+         flattenTargets[k].attempts = 0;
+         if (!FlattenSend(k)) FlattenTargetDone(k);
+      }
+   } else if (trans.type == TRADE_TRANSACTION_HISTORY_ADD) {
+      if (trans.order_state != ORDER_STATE_CANCELED && trans.order_state != ORDER_STATE_EXPIRED &&
+          trans.order_state != ORDER_STATE_REJECTED) return;
+      
+      int k = FindFlattenTarget(trans.order, false);
+      if (k >= 0) FlattenTargetDone(k);
    }
+}
+
+// Targets not confirmed by the deadline are rescanned in the next round
+void CheckFlattenTimeout() {
+   if (!flattenActive || GetTickCount64() < flattenDeadlineMs) return;
    
-   order3.ticket = trade.PositionOpen(_Symbol, type, LotSize, s.entry, s.sl, tp3, "TP3 Trade");
-   if (order3.ticket == 0) {
-      LogMessage("Failed to open position 3: " + IntegerToString(trade.ResultRetcode()));
-      trade.PositionClose(order1.ticket);
-      trade.PositionClose(order2.ticket);
-      return false;
+   LogFmt(LOG_LEVEL_WARN, "Flatten round %i: %i requests unconfirmed after " + IntegerToString(AsyncAckTimeoutMs) + " ms",
+          flattenRounds, flattenOpen);
+   for (int k = 0; k < flattenTargetCount; k++) {
+      flattenTargets[k].done = true;
+      flattenTargets[k].requestId = 0;
+   }
+   flattenOpen = 0;
+   FlattenRoundDone();
+}
+
+void FinishFlatten() {
+   int left = 0;
+   for (int i = PositionsTotal() - 1; i >= 0; i--) {
+      if (PositionGetTicket(i) != 0 && PositionGetInteger(POSITION_MAGIC) == MagicNumber) left++;
+   }
+   for (int i = OrdersTotal() - 1; i >= 0; i--) {
+      if (OrderGetTicket(i) != 0 && OrderGetInteger(ORDER_MAGIC) == MagicNumber) left++;
    }
    
-   // Mark as positions (not pending orders)
-   order1.isPosition = true;
-   order2.isPosition = true;
-   order3.isPosition = true;
-   tradesOpened = true;
+   flattenActive = false;
+   flattenTargetCount = 0;
+   flattenOpen = 0;
+   flattenLastUs = GetMicrosecondCount() - flattenStartUs;
+   flattenLastLeft = left;
    
-   return true;
+   string ms = DoubleToString(flattenLastUs / 1000.0, 1);
+   if (left == 0) {
+      LogFmt(LOG_LEVEL_INFO, "Flat in %s ms: %i requests over %i rounds", flattenRequests, flattenRounds, 0, ms);
+   } else {
+      LogFmt(LOG_LEVEL_ERROR, "Flatten gave up after %s ms: %i orders and positions still open, %i requests sent", left,
+             flattenRequests, 0, ms);
+   }
 }
 
-void InitializeOrderStates() {
-   order1.isActive = true;
-   order1.isPosition = !UseLimitOrders; // Market orders are immediately positions
-   order1.tp1_hit = false;
-   order1.tp2_hit = false;
-   order1.sl_moved_to_entry = false;
-   order1.sl_moved_to_tp1 = false;
-   
-   order2.isActive = true;
-   order2.isPosition = !UseLimitOrders;
-   order2.tp1_hit = false;
-   order2.tp2_hit = false;
-   order2.sl_moved_to_entry = false;
-   order2.sl_moved_to_tp1 = false;
-   
-   order3.isActive = true;
-   order3.isPosition = !UseLimitOrders;
-   order3.tp1_hit = false;
-   order3.tp2_hit = false;
-   order3.sl_moved_to_entry = false;
-   order3.sl_moved_to_tp1 = false;
-}
-
-bool ValidateSignalParams(SignalParams &s) {
-   if (s.signal != "BUY" && s.signal != "SELL") {
-      LogMessage("Invalid signal type: " + s.signal);
-      return false;
+// Offline replay. Recorded ticks and a signal log run through the same slot
+// state machine as live trading. Placement, SL moves, cancels and closes go
+// to a paper book instead of the terminal, and the paper book's fills and
+// closes are routed back through MarkLegFilled/MarkLegClosed exactly as
+// OnTradeTransaction would. Nothing is sent to the broker.
+//
+// ReplayTickFile: ticks of the chart symbol, as *.csv rows
+// "time_msc,bid,ask", otherwise raw MqlTick records as written by
+// FileWriteArray() on a CopyTicks() result.
+// ReplaySignalFile: one JSON signal object per line, ordered by timestamp,
+// on the same clock as the ticks. The file holds a single tick stream, so
+// signals for any symbol other than the chart's are skipped.
+void RunReplay() {
+   int replaySym = FindSymbolSpec(_Symbol);
+   if (replaySym < 0) {
+      LogError("Replay: the chart symbol " + _Symbol + " must be one of TradeSymbols");
+      return;
    }
    
-   double currentPrice = SymbolInfoDouble(_Symbol, s.signal == "BUY" ? SYMBOL_ASK : SYMBOL_BID);
+   replayActive = true;
+   ZeroMemory(replayTick);
+   replayFills = 0;
+   replaySlMoves = 0;
+   replayCloses = 0;
+   replayPnl = 0;
+   replayNextTicket = 1;
    
-   if (s.signal == "BUY") {
-      if (s.sl >= s.entry || s.tp1 <= s.entry || s.tp2 <= s.tp1) {
-         LogMessage("Invalid BUY signal levels");
-         return false;
+   int signalCount = LoadReplaySignals(replaySym);
+   
+   bool csv = StringFind(ReplayTickFile, ".csv") > 0;
+   int ticks = FileOpen(ReplayTickFile, FILE_READ | FILE_SHARE_READ | (csv ? FILE_CSV | FILE_ANSI : FILE_BIN), ',');
+   if (ticks == INVALID_HANDLE) {
+      LogError("Replay: cannot open " + ReplayTickFile + ". Error: " + IntegerToString(GetLastError()));
+      replayActive = false;
+      return;
+   }
+   
+   replayReport = INVALID_HANDLE;
+   if (ReplayReportFile != "") {
+      replayReport = FileOpen(ReplayReportFile, FILE_WRITE | FILE_CSV | FILE_ANSI, ',');
+      if (replayReport != INVALID_HANDLE) {
+         FileWrite(replayReport, "time_msc", "signal_id", "leg", "event", "price", "sl", "pnl");
       }
-      // For limit orders, entry should be below current price
-      if (UseLimitOrders && s.entry >= currentPrice) {
-         LogMessage("BUY limit order entry price should be below current price");
-         return false;
+   }
+   
+   MqlTick chunk[];
+   ArrayResize(chunk, 65536);
+   int nextSignal = 0;
+   long tickCount = 0;
+   ulong t0 = GetMicrosecondCount();
+   
+   while (!FileIsEnding(ticks)) {
+      int n;
+      if (csv) {
+         n = 0;
+         while (n < 65536 && !FileIsEnding(ticks)) {
+            chunk[n].time_msc = (long)FileReadNumber(ticks);
+            chunk[n].bid = FileReadNumber(ticks);
+            chunk[n].ask = FileReadNumber(ticks);
+            if (chunk[n].time_msc > 0) n++; // Skips the header row
+         }
+      } else {
+         n = (int)FileReadArray(ticks, chunk, 0, 65536);
+         if (n <= 0) break;
       }
-   } else {
-      if (s.sl <= s.entry || s.tp1 >= s.entry || s.tp2 >= s.tp1) {
-         LogMessage("Invalid SELL signal levels");
-         return false;
+      
+      for (int k = 0; k < n; k++) {
+         replayTick = chunk[k];
+         
+         while (nextSignal < signalCount && replaySignalMs[nextSignal] <= replayTick.time_msc) {
+            InjectReplaySignal(replaySignals[nextSignal]);
+            nextSignal++;
+         }
+         if (liveSlotCount == 0) continue;
+         
+         MatchPaperBook(replayTick.bid, replayTick.ask);
+         if (!EnableTrailingStops) continue;
+         ManageBuySlots(replaySym, replayTick.bid);
+         ManageSellSlots(replaySym, replayTick.ask);
       }
-      // For limit orders, entry should be above current price
-      if (UseLimitOrders && s.entry <= currentPrice) {
-         LogMessage("SELL limit order entry price should be above current price");
-         return false;
+      tickCount += n;
+      FlushLog(LOG_RING_SIZE);
+   }
+   ulong elapsedUs = GetMicrosecondCount() - t0;
+   FileClose(ticks);
+   
+   // Mark whatever is still open to the last tick
+   double openPnl = 0;
+   for (int i = 0; i < liveSlotCount; i++) {
+      int slotIndex = liveSlots[i];
+      for (int leg = 0; leg < slots[slotIndex].legCount; leg++) {
+         int ref = slotIndex * MAX_LEGS + leg;
+         if (paperBook[ref].state != PAPER_POSITION) continue;
+         openPnl += PaperPnl(paperBook[ref], paperBook[ref].dir > 0 ? replayTick.bid : replayTick.ask);
       }
    }
    
-   return true;
+   if (replayReport != INVALID_HANDLE) FileClose(replayReport);
+   replayReport = INVALID_HANDLE;
+   
+   LogMessage("Replay: " + IntegerToString(tickCount) + " ticks, " + IntegerToString(nextSignal) + "/" +
+              IntegerToString(signalCount) + " signals in " + DoubleToString(elapsedUs / 1000.0, 1) + " ms (" +
+              DoubleToString(elapsedUs > 0 ? tickCount * 1000000.0 / elapsedUs : 0, 0) + " ticks/s, " +
+              DoubleToString(tickCount > 0 ? elapsedUs * 1000.0 / tickCount : 0, 1) + " ns/tick)");
+   LogMessage("Replay: " + IntegerToString(replayFills) + " fills, " + IntegerToString(replaySlMoves) + " SL moves, " +
+              IntegerToString(replayCloses) + " closes, realised PnL " + DoubleToString(replayPnl, 2) +
+              ", open PnL " + DoubleToString(openPnl, 2));
+   
+   ResetAfterReplay();
 }
 
-void SimulateIncomingSignal() {
-   double currentPrice = SymbolInfoDouble(_Symbol, SYMBOL_BID);
+// Read the signals for symbol sym from ReplaySignalFile into
+// replaySignals/replaySignalMs
+int LoadReplaySignals(int sym) {
+   ArrayResize(replaySignals, 0);
+   ArrayResize(replaySignalMs, 0);
+   if (ReplaySignalFile == "") return 0;
    
-   if (UseLimitOrders) {
-      // Example BUY LIMIT signal (entry below current price)
-      sig.signal = "BUY";
-      sig.entry = 3320 - 50 * _Point; // 5 pips below current price
-      sig.sl = 3310 - 50 * _Point;       // 5 pips below entry
-      sig.tp1 = 3321 + 100 * _Point;     // 10 pips above entry
-      sig.tp2 = 3322 + 200 * _Point;     // 20 pips above entry
-      
-      /* Example SELL LIMIT signal (entry above current price)
-      sig.signal = "SELL";
-      sig.entry = currentPrice + 50 * _Point; // 5 pips above current price
-      sig.sl = sig.entry + 50 * _Point;       // 5 pips above entry
-      sig.tp1 = sig.entry - 100 * _Point;     // 10 pips below entry
-      sig.tp2 = sig.entry - 200 * _Point;     // 20 pips below entry
-      */
-   } else {
-      // Original market order example
-      sig.signal = "BUY";
-      sig.entry = 3329.50;
-      sig.sl = 3320.00;
-      sig.tp1 = 3330.50;
-      sig.tp2 = 3332.50;
+   int handle = FileOpen(ReplaySignalFile, FILE_READ | FILE_TXT | FILE_ANSI | FILE_SHARE_READ);
+   if (handle == INVALID_HANDLE) {
+      LogError("Replay: cannot open " + ReplaySignalFile + ". Error: " + IntegerToString(GetLastError()));
+      return 0;
    }
    
-   LogMessage("Processing " + sig.signal + " signal");
-   bool success = OpenSignalTrades(sig);
-   
-   if (success) {
-      LogMessage("Signal processed successfully");
-   } else {
-      LogMessage("Failed to process signal");
+   int count = 0;
+   while (!FileIsEnding(handle)) {
+      string line = FileReadString(handle);
+      int pos = 0;
+      SignalParams sig;
+      // Feed commands act on the live account; the paper book has no use for them
+      if (StringLen(line) == 0 || !ParseSignalFromJSON(line, pos, sig) || sig.command != "") continue;
+      
+      if (sig.symbol != symbolSpecs[sym].name) {
+         LogWarn("Replay: signal " + sig.id + " is for " + sig.symbol + ", the ticks are " + symbolSpecs[sym].name + ", skipped");
+         continue;
+      }
+      
+      long ms = ParseSignalTimeMs(sig.timestamp);
+      if (ms == 0) {
+         LogWarn("Replay: signal " + sig.id + " has no usable timestamp, skipped");
+         continue;
+      }
+      
+      ArrayResize(replaySignals, count + 1, 256);
+      ArrayResize(replaySignalMs, count + 1, 256);
+      replaySignals[count] = sig;
+      replaySignalMs[count] = ms;
+      count++;
    }
+   FileClose(handle);
+   return count;
 }
 
-// Clean up function
-void CloseAllPositions() {
-   // Close positions
-   if (order1.isPosition && order1.isActive) trade.PositionClose(order1.ticket);
-   if (order2.isPosition && order2.isActive) trade.PositionClose(order2.ticket);
-   if (order3.isPosition && order3.isActive) trade.PositionClose(order3.ticket);
+void InjectReplaySignal(SignalParams &sig) {
+   SignalRecord record;
+   if (!CompileSignal(sig, record)) return;
+   int index = AcquireSlot(record);
+   if (index < 0) {
+      LogMessage("Replay: no free signal slot for " + sig.id);
+      return;
+   }
    
-   // Cancel pending orders
-   if (!order1.isPosition && order1.isActive) trade.OrderDelete(order1.ticket);
-   if (!order2.isPosition && order2.isActive) trade.OrderDelete(order2.ticket);
-   if (!order3.isPosition && order3.isActive) trade.OrderDelete(order3.ticket);
+   if (!OpenSignalTrades(slots[index])) ReleaseSlot(index);
+}
+
+// Fill pending legs whose limit price was touched, expire stale ones, and
+// close positions at SL or TP. Limits fill at their price, stops and targets
+// at the level itself (no slippage model).
+void MatchPaperBook(double bid, double ask) {
+   for (int i = liveSlotCount - 1; i >= 0; i--) {
+      int slotIndex = liveSlots[i];
+      
+      for (int leg = 0; leg < slots[slotIndex].legCount && slots[slotIndex].inUse; leg++) {
+         int ref = slotIndex * MAX_LEGS + leg;
+         if (paperBook[ref].state == PAPER_PENDING) {
+            bool touched = paperBook[ref].dir > 0 ? ask <= paperBook[ref].price : bid >= paperBook[ref].price;
+            if (touched) {
+               paperBook[ref].state = PAPER_POSITION;
+               replayFills++;
+               WriteReplayEvent(ref, "filled", paperBook[ref].price, 0);
+               MarkLegFilled(slotIndex, leg, paperBook[ref].price);
+            } else if (replayTick.time_msc >= paperBook[ref].expiryMs) {
+               paperBook[ref].state = PAPER_NONE;
+               WriteReplayEvent(ref, "expired", 0, 0);
+               MarkLegClosed(slotIndex, leg, "expired or cancelled");
+            }
+         } else if (paperBook[ref].state == PAPER_POSITION) {
+            // A buy closes on the bid, a sell on the ask
+            double exitPrice = paperBook[ref].dir > 0 ? bid : ask;
+            double level = 0;
+            if ((exitPrice - paperBook[ref].sl) * paperBook[ref].dir <= 0) level = paperBook[ref].sl;
+            else if ((exitPrice - paperBook[ref].tp) * paperBook[ref].dir >= 0) level = paperBook[ref].tp;
+            if (level == 0) continue;
+            
+            ClosePaperPosition(ref, level);
+            MarkLegClosed(slotIndex, leg, "closed", level);
+         }
+      }
+   }
+}
+
+double PaperPnl(PaperOrder &order, double exitPrice) {
+   return (exitPrice - order.price) * order.dir * order.lots * order.contractSize;
+}
+
+void ClosePaperPosition(int ref, double price) {
+   double pnl = PaperPnl(paperBook[ref], price);
+   paperBook[ref].state = PAPER_NONE;
+   replayCloses++;
+   replayPnl += pnl;
+   WriteReplayEvent(ref, "closed", price, pnl);
+}
+
+void WriteReplayEvent(int ref, string event, double price, double pnl) {
+   if (replayReport == INVALID_HANDLE) return;
+   int digits = symbolSpecs[slots[ref / MAX_LEGS].sym].digits;
+   FileWrite(replayReport, replayTick.time_msc, SignalIdOf(slots[ref / MAX_LEGS].sig.id), ref % MAX_LEGS + 1, event,
+             DoubleToString(price, digits), DoubleToString(paperBook[ref].sl, digits), DoubleToString(pnl, 2));
+}
+
+// Drop every replayed slot and the side effects the live EA must not see
+void ResetAfterReplay() {
+   for (int i = liveSlotCount - 1; i >= 0; i--) ReleaseSlot(liveSlots[i]);
+   for (int i = 0; i < MAX_SIGNAL_SLOTS * MAX_LEGS; i++) paperBook[i].state = PAPER_NONE;
    
-   tradesOpened = false;
-   ordersPlaced = false;
-   LogMessage("All positions and orders closed/cancelled manually");
+   statusHead = 0;
+   statusCount = 0;
+   statusDropped = 0;
+   ZeroMemory(latencyStages);
+   replayActive = false;
 }
 
 int OnInit() {
    LogMessage("Enhanced Gold Processor EA initialized");
    LogMessage("Order Type: " + (UseLimitOrders ? "LIMIT ORDERS" : "MARKET ORDERS"));
    LogMessage("Webhook Port: " + WebhookPort);
-   LogMessage("Lot Size: " + DoubleToString(LotSize, 2));
+   LogMessage("Lot Size: " + DoubleToString(LotSize, 2) + (AccountLotScale != 1.0 || LotScaleReferenceBalance > 0 ?
+              " (this account: " + DoubleToString(AccountLots(), 2) + ")" : ""));
    LogMessage("Magic Number: " + IntegerToString(MagicNumber));
+   LogMessage("Max Concurrent Signals: " + IntegerToString(MathMin(MaxConcurrentSignals, MAX_SIGNAL_SLOTS)));
    LogMessage("Order Expiration: " + IntegerToString(OrderExpirationHours) + " hours");
    
-   // Initialize trade object
+   if (!LoadSymbolSpecs()) {
+      LogError("No tradable symbol configured");
+      return INIT_FAILED;
+   }
+   string symbolList = "";
+   for (int i = 0; i < symbolCount; i++) symbolList += (i > 0 ? ", " : "") + symbolSpecs[i].name;
+   LogMessage("Symbols: " + symbolList);
+   
+   // Before anything stamps a latency trace
+   AnchorWallClock();
+   
+   // Initialize trade object; the filling mode is set per symbol on each placement
    trade.SetExpertMagicNumber(MagicNumber);
    trade.SetMarginMode();
    trade.SetTypeFillingBySymbol(_Symbol);
    
+   // The timer drives signal polling and the leg reconciliation sweep; the
+   // push channel and the signal journal are checked every 10 ms
+   bool journalMode = SignalJournalFile != "" || FanoutJournalFile != "";
+   int timerMs = EnablePushChannel || journalMode ? 10 : MathMax(MathMin(PollMinIntervalMs, 100), 10);
+   if (!EventSetMillisecondTimer(timerMs)) {
+      LogError("Failed to start timer. Error: " + IntegerToString(GetLastError()));
+      return INIT_FAILED;
+   }
+   nextReconcileMs = GetTickCount64() + (ulong)MathMax(ReconcileIntervalSeconds, 1) * 1000;
+   
+   if (RunParserBenchmark) {
+      BenchmarkSignalParser();
+   }
+   
+   if (RunBenchmarks && !RunBenchmarkSuite()) {
+      return INIT_FAILED;
+   }
+   
+   if (ReplayTickFile != "") {
+      RunReplay();
+   }
+   
+   // After replay and benchmarks, which reset the slot table
+   if (StateJournalFile != "") {
+      RecoverState();
+   }
+   
    // Only run simulation if webhook mode is disabled or auto-simulation is enabled
    if (!EnableWebhookMode && AutoRunSimulation) {
       LogMessage("Running simulation (webhook mode disabled)...");
       SimulateIncomingSignal();
+   } else if (SignalJournalFile != "") {
+      LogMessage("Signal journal mode. Tailing " + SignalJournalFile + " in the Common files folder");
+   } else if (FanoutJournalFile != "") {
+      LogMessage("Fan-out mode. Electing a leader over " + FanoutJournalFile + " in the Common files folder");
    } else if (EnableWebhookMode) {
       LogMessage("Webhook mode enabled. Waiting for signals from: " + WebhookGetURL);
    } else {
@@ -705,14 +4830,62 @@ int OnInit() {
 }
 
 void OnDeinit(const int reason) {
+   EventKillTimer();
+   if (pushSocket != INVALID_HANDLE) {
+      SocketClose(pushSocket);
+      pushSocket = INVALID_HANDLE;
+   }
+   for (int i = 0; i < symbolCount; i++) {
+      if (symbolSpecs[i].atrHandle != INVALID_HANDLE) IndicatorRelease(symbolSpecs[i].atrHandle);
+   }
+   
+   // One last attempt to deliver queued status events
+   nextStatusFlushMs = 0;
+   FlushStatusQueue(true);
+   LogPickupLatencyStats();
+   if (EnablePushChannel) LogMessage("Push channel: " + IntegerToString(pushSignalFrames) + " signal frames received");
+   if (FanoutLeader()) {
+      LogMessage("Fan-out: published " + IntegerToString(fanoutPublished) + " signals as leader");
+      FileClose(fanoutWriter);
+      FileClose(fanoutLock);
+      fanoutWriter = INVALID_HANDLE;
+      fanoutLock = INVALID_HANDLE;
+   }
+   if (feedFile != INVALID_HANDLE) {
+      FileClose(feedFile);
+      feedFile = INVALID_HANDLE;
+      LogMessage("Signal journal: " + IntegerToString(feedRecords) + " records read, " + IntegerToString(feedCorrupt) + " corrupt skipped");
+   }
+   LogMessage("Polls: " + IntegerToString(pollsUseful) + " useful, " + IntegerToString(pollsEmpty) + " empty, " +
+              IntegerToString(pollsStale) + " stale, " + IntegerToString(pollsFailed) + " failed");
+   LogMessage("Placement retries: " + IntegerToString(retryAttempts) + " attempts, " + IntegerToString(retrySignalsRecovered) +
+              " signals recovered (+" + IntegerToString(retryAddedUsSum) + " us total), " + IntegerToString(retryExhausted) + " legs exhausted");
+   LogMessage("Signal intake: " + IntegerToString(intakeExecuted) + " executed (avg wait " +
+              IntegerToString(intakeExecuted > 0 ? intakeWaitSumMs / intakeExecuted : 0) + " ms, max " +
+              IntegerToString(intakeWaitMaxMs) + " ms), " + IntegerToString(intakeExpired) + " expired, " +
+              IntegerToString(intakeOvertaken) + " overtaken by the market, " + IntegerToString(intakeCount) + " still queued");
+   if (flattenRuns > 0) {
+      LogMessage("Flatten: " + IntegerToString(flattenRuns) + " runs, last flat in " + DoubleToString(flattenLastUs / 1000.0, 1) +
+                 " ms with " + IntegerToString(flattenLastLeft) + " left open");
+   }
+   LogMessage("Signal dedup: " + IntegerToString(dedupHits) + " hits, " + IntegerToString(dedupMisses) + " misses (" +
+              IntegerToString(dedupExpired) + " past TTL)");
+   DumpLatencyCsv();
+   JournalDirtySlots();
+   if (journalFile != INVALID_HANDLE) FileClose(journalFile);
+   journalFile = INVALID_HANDLE;
    LogMessage("EA deinitialized. Reason: " + IntegerToString(reason));
+   CloseLog();
 }
 
 void OnTradeTransaction(const MqlTradeTransaction& trans,
                        const MqlTradeRequest& request,
                        const MqlTradeResult& result) {
-   if (EnableLogging && trans.symbol == _Symbol) {
-      LogMessage("Trade transaction: " + EnumToString(trans.type) + 
-                " for ticket " + IntegerToString(trans.order));
+   if (FindSymbolSpec(trans.symbol) >= 0) {
+      LogDebug("Trade transaction: " + EnumToString(trans.type) + 
+               " for ticket " + IntegerToString(trans.order));
    }
+   
+   if (flattenActive) ApplyFlattenTransaction(trans, result);
+   ApplyTradeTransaction(trans, result);
 }
\ No newline at end of file
@@ -0,0 +1,175 @@
+"""Append-only signal journal shared with the gold_processor EA.
+
+When the forwarder and the terminal run on the same host, signals can skip
+the HTTP service entirely: they are appended as fixed-size records to a file
+in the terminal's Common files folder (EA input SignalJournalFile) and the EA
+tails it by offset. Every record is
+
+    magic     uint32   0x31464753 ("SGF1")
+    seq       int64    1-based; record n sits at (n - 1) * RECORD_SIZE
+    feed_seq  int64    upstream feed cursor ("seq" of the signal, 0 = none)
+    posted_ms int64    channel post time, UTC milliseconds (0 = unknown)
+    direction int8     1 BUY, -1 SELL, 0 flatten command (prices unused)
+    entry, sl, tp1, tp2   float64
+    symbol    16 bytes  "" = the EA's first TradeSymbols entry
+    id        64 bytes  page_id, used by the EA for dedup
+    checksum  uint32   FNV-1a over every byte before it
+
+all little-endian with no padding. A writer that died mid-append leaves a
+torn tail; it is truncated the next time the journal is opened, so the EA
+only ever sees whole records.
+
+Run directly to append JSON signal lines read from stdin:
+
+    $ SIGNAL_JOURNAL_PATH=/path/to/Common/Files/signals.bin python signal_journal.py
+    {"signal": "BUY", "entry": 3320.5, "sl": 3310, "tp1": 3325.5, "tp2": 3330.5, "page_id": "test-1"}
+    {"command": "flatten", "page_id": "flatten-1"}
+"""
+import json
+import logging
+import os
+import struct
+import sys
+import time
+from datetime import datetime, timezone
+
+from dotenv import load_dotenv
+
+load_dotenv()
+
+logging.basicConfig(
+    level=logging.INFO,
+    format='[%(levelname)s] %(asctime)s - %(name)s - %(message)s',
+    datefmt='%Y-%m-%d %H:%M:%S',
+)
+logger = logging.getLogger(__name__)
+
+RECORD_MAGIC = 0x31464753
+BODY_FORMAT = '<Iqqqb4d16s64s'
+BODY_SIZE = struct.calcsize(BODY_FORMAT)
+RECORD_SIZE = BODY_SIZE + 4
+
+
+def fnv1a32(data):
+    h = 2166136261
+    for b in data:
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def default_journal_path():
+    """SIGNAL_JOURNAL_PATH, else signals.bin in the MetaTrader Common files folder"""
+    path = os.getenv('SIGNAL_JOURNAL_PATH')
+    if path:
+        return path
+    common = os.path.join(os.getenv('APPDATA', ''), 'MetaQuotes', 'Terminal', 'Common', 'Files')
+    return os.path.join(common, 'signals.bin')
+
+
+def parse_posted_ms(timestamp):
+    """Milliseconds for "2025-01-15T10:30:45[.123]" style UTC timestamps, 0 if unparseable"""
+    if not timestamp:
+        return 0
+    ts = str(timestamp)
+    try:
+        dt = datetime.fromisoformat(ts[:10].replace('.', '-') + 'T' + ts[11:].rstrip('Z'))
+    except ValueError:
+        return 0
+    if dt.tzinfo is None:
+        dt = dt.replace(tzinfo=timezone.utc)
+    return int(dt.timestamp() * 1000)
+
+
+def valid_record(data, seq):
+    if len(data) != RECORD_SIZE:
+        return False
+    magic, record_seq = struct.unpack_from('<Iq', data)
+    (checksum,) = struct.unpack_from('<I', data, BODY_SIZE)
+    return magic == RECORD_MAGIC and record_seq == seq and checksum == fnv1a32(data[:BODY_SIZE])
+
+
+class SignalJournalWriter:
+    def __init__(self, path=None, fsync=None):
+        self.path = path or default_journal_path()
+        if fsync is None:
+            fsync = os.getenv('SIGNAL_JOURNAL_FSYNC', '1') != '0'
+        self.fsync = fsync
+        self.file = open(self.path, 'a+b')
+        self.seq = self.recover()
+        logger.info(f"Signal journal {self.path} open at seq {self.seq}")
+
+    def recover(self):
+        """Drop a torn tail and return the seq of the last whole record"""
+        size = os.path.getsize(self.path)
+        end = size - size % RECORD_SIZE
+        while end > 0:
+            self.file.seek(end - RECORD_SIZE)
+            if valid_record(self.file.read(RECORD_SIZE), end // RECORD_SIZE):
+                break
+            end -= RECORD_SIZE
+        if end != size:
+            logger.warning(f"Truncating {size - end} bytes of torn tail from {self.path}")
+            self.file.truncate(end)
+            self.file.flush()
+            os.fsync(self.file.fileno())
+        return end // RECORD_SIZE
+
+    def append(self, signal):
+        """Append one signal or command dict in the EA's JSON field names; returns its seq"""
+        command = signal.get('command')
+        if command is not None:
+            if command != 'flatten':
+                raise ValueError(f"unknown command {command!r}")
+            direction = 0
+            signal = {**signal, 'entry': 0, 'sl': 0, 'tp1': 0, 'tp2': 0}
+        else:
+            side = str(signal.get('signal', '')).upper()
+            direction = 1 if side == 'BUY' else -1 if side == 'SELL' else 0
+            if direction == 0:
+                raise ValueError(f"invalid signal type {signal.get('signal')!r}")
+
+        posted_ms = parse_posted_ms(signal.get('timestamp')) or int(time.time() * 1000)
+        body = struct.pack(
+            BODY_FORMAT,
+            RECORD_MAGIC,
+            self.seq + 1,
+            int(signal.get('seq', 0) or 0),
+            posted_ms,
+            direction,
+            float(signal['entry']),
+            float(signal['sl']),
+            float(signal['tp1']),
+            float(signal['tp2']),
+            str(signal.get('symbol', '')).encode()[:15],
+            str(signal.get('page_id', '')).encode()[:63],
+        )
+        # One write per record: a crash leaves at most one torn record at the tail
+        self.file.write(body + struct.pack('<I', fnv1a32(body)))
+        self.file.flush()
+        if self.fsync:
+            os.fsync(self.file.fileno())
+        self.seq += 1
+        return self.seq
+
+    def close(self):
+        self.file.close()
+
+
+def main():
+    writer = SignalJournalWriter()
+    try:
+        for line in sys.stdin:
+            line = line.strip()
+            if not line:
+                continue
+            try:
+                seq = writer.append(json.loads(line))
+                logger.info(f"Appended signal seq={seq}")
+            except (ValueError, KeyError) as e:
+                logger.warning(f"Ignoring signal line: {e}")
+    finally:
+        writer.close()
+
+
+if __name__ == "__main__":
+    main()
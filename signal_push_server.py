@@ -0,0 +1,134 @@
+"""Local stand-in for the signal service's push channel.
+
+Serves the gold_processor EA push protocol on one TCP port. Every frame is a
+4-byte big-endian length (type byte + payload), a type byte and a payload:
+
+    H  EA -> server  hello, payload "token=<token>&since=<seq>"
+    S  server -> EA  signal, payload is the same JSON the GET endpoint returns
+    B  both ways     heartbeat, empty payload
+
+Signals are read from stdin, one JSON object per line. Each one gets the
+next "seq" and is pushed to every connected EA. On connect, signals newer
+than the EA's cursor are replayed as a single JSON array.
+"""
+import asyncio
+import json
+import logging
+import os
+import struct
+import sys
+
+from dotenv import load_dotenv
+
+load_dotenv()
+
+logging.basicConfig(
+    level=logging.INFO,
+    format='[%(levelname)s] %(asctime)s - %(name)s - %(message)s',
+    datefmt='%Y-%m-%d %H:%M:%S',
+)
+logger = logging.getLogger(__name__)
+
+FRAME_HELLO = b'H'
+FRAME_SIGNAL = b'S'
+FRAME_HEARTBEAT = b'B'
+MAX_FRAME = 1024 * 1024
+
+
+def encode_frame(frame_type, payload=b''):
+    return struct.pack('>I', len(payload) + 1) + frame_type + payload
+
+
+async def read_frame(reader):
+    header = await reader.readexactly(4)
+    (length,) = struct.unpack('>I', header)
+    if length == 0 or length > MAX_FRAME:
+        raise ValueError(f"bad frame length {length}")
+    body = await reader.readexactly(length)
+    return body[:1], body[1:]
+
+
+class SignalPushServer:
+    def __init__(self):
+        self.host = os.getenv('PUSH_HOST', '127.0.0.1')
+        self.port = int(os.getenv('PUSH_PORT', '9001'))
+        self.token = os.getenv('PUSH_TOKEN', '')
+        self.heartbeat_seconds = float(os.getenv('PUSH_HEARTBEAT_SECONDS', '5'))
+        self.history = []
+        self.seq = 0
+        self.clients = set()
+
+    async def handle_client(self, reader, writer):
+        peer = writer.get_extra_info('peername')
+        try:
+            frame_type, payload = await asyncio.wait_for(read_frame(reader), timeout=10)
+            if frame_type != FRAME_HELLO:
+                raise ValueError("expected hello")
+            hello = dict(p.split('=', 1) for p in payload.decode().split('&') if '=' in p)
+            if self.token and hello.get('token') != self.token:
+                raise ValueError("bad token")
+
+            since = int(hello.get('since', '0') or 0)
+            backlog = [s for s in self.history if s['seq'] > since]
+            if backlog:
+                writer.write(encode_frame(FRAME_SIGNAL, json.dumps(backlog).encode()))
+                await writer.drain()
+
+            logger.info(f"EA connected from {peer}, cursor {since}, replayed {len(backlog)} signals")
+            self.clients.add(writer)
+            heartbeat = asyncio.create_task(self.send_heartbeats(writer))
+            try:
+                while True:
+                    # Anything from the EA (heartbeats) just proves it is alive
+                    await asyncio.wait_for(read_frame(reader), timeout=3 * self.heartbeat_seconds)
+            finally:
+                heartbeat.cancel()
+                self.clients.discard(writer)
+        except (asyncio.IncompleteReadError, asyncio.TimeoutError, ConnectionError, ValueError) as e:
+            logger.info(f"EA {peer} disconnected: {e or type(e).__name__}")
+        finally:
+            writer.close()
+
+    async def send_heartbeats(self, writer):
+        while True:
+            await asyncio.sleep(self.heartbeat_seconds)
+            writer.write(encode_frame(FRAME_HEARTBEAT))
+            await writer.drain()
+
+    async def publish(self, signal):
+        self.seq += 1
+        signal['seq'] = self.seq
+        self.history = self.history[-999:] + [signal]
+        frame = encode_frame(FRAME_SIGNAL, json.dumps(signal).encode())
+        for writer in list(self.clients):
+            try:
+                writer.write(frame)
+                await writer.drain()
+            except ConnectionError:
+                self.clients.discard(writer)
+        logger.info(f"Pushed signal seq={self.seq} to {len(self.clients)} EA(s)")
+
+    async def read_stdin(self):
+        loop = asyncio.get_running_loop()
+        while True:
+            line = await loop.run_in_executor(None, sys.stdin.readline)
+            if not line:
+                return
+            line = line.strip()
+            if not line:
+                continue
+            try:
+                await self.publish(json.loads(line))
+            except json.JSONDecodeError as e:
+                logger.warning(f"Ignoring invalid JSON line: {e}")
+
+    async def run(self):
+        server = await asyncio.start_server(self.handle_client, self.host, self.port)
+        logger.info(f"Push channel listening on {self.host}:{self.port}")
+        async with server:
+            await self.read_stdin()
+            await server.serve_forever()
+
+
+if __name__ == "__main__":
+    asyncio.run(SignalPushServer().run())
@@ -6,6 +6,10 @@ from telethon.errors import FloodWaitError
 import os
 from dotenv import load_dotenv
 import asyncio
+import json
+from concurrent.futures import ThreadPoolExecutor
+
+from signal_journal import SignalJournalWriter
 
 load_dotenv()
 
@@ -34,6 +38,12 @@ class TelegramForwarder:
             raise ValueError("Missing required environment variables.")
         
         self.client = TelegramClient(StringSession(session_string), self.api_id, self.api_hash)
+
+        # Optional same-host handoff to the EA through the signal journal
+        journal_path = os.getenv('SIGNAL_JOURNAL_PATH')
+        self.journal = SignalJournalWriter(journal_path) if journal_path else None
+        # Appends may fsync; one worker keeps them off the event loop and in order
+        self.journal_executor = ThreadPoolExecutor(max_workers=1) if self.journal else None
     
     async def get_channel_entity(self, channel_identifier):
         """Get channel entity from username or ID"""
@@ -59,12 +69,30 @@ class TelegramForwarder:
             @self.client.on(events.NewMessage(chats=source_entity))
             async def message_handler(event):
                 logger.info(f"New message received: {event.message.text[:50]}...")
+                if self.journal:
+                    await self.journal_signal(event)
                 await self.forward_message(event)
 
         except Exception as e:
             logger.error(f"Failed to setup message handler: {e}")
             raise
 
+    async def journal_signal(self, event):
+        """Append the message to the signal journal if it is a JSON signal or command.
+        Never raises, so a message that cannot be journaled is still forwarded."""
+        try:
+            signal = json.loads(event.message.text or '')
+        except ValueError:
+            return
+        if not isinstance(signal, dict) or ('signal' not in signal and 'command' not in signal):
+            return
+        try:
+            loop = asyncio.get_running_loop()
+            seq = await loop.run_in_executor(self.journal_executor, self.journal.append, signal)
+            logger.info(f"Signal journaled as seq={seq}")
+        except Exception as e:
+            logger.warning(f"Failed to journal signal: {e}")
+
     async def forward_message(self, event):
         """Forward message to destination channel"""
         try: